@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "code_scaling.h"
+
+// ==================== ADC CALIBRATION ====================
+// Calibrated sensor conversion is a single load from a 4096-entry RAM
+// table (raw code -> 0.1 mV). The table is built at startup from the
+// eFuse characterization (esp_adc_cal, ADC1 at 11 dB) and then corrected
+// by optional user points: one point shifts the offset, two or more
+// correct piecewise-linearly between points (extrapolated past the ends).
+// Points persist in NVS (Preferences namespace "station", key "adccal").
+
+const size_t MAX_CAL_POINTS = 8;
+const uint32_t DEFAULT_VREF_MV = 1100;  // Used when the eFuse holds no Vref
+
+struct CalPoint {
+  uint16_t code;  // Averaged raw ADC code
+  uint16_t dmv;   // Reference voltage applied [0.1 mV]
+};
+
+extern uint16_t adcCalTable[ADC_MAX_CODE + 1];
+
+inline uint16_t calibratedDmv(uint16_t code) {
+  return adcCalTable[code > ADC_MAX_CODE ? ADC_MAX_CODE : code];
+}
+
+// Characterizes ADC1, loads user points and builds the table
+void beginAdcCalibration();
+
+// Adds (or replaces a nearby) user point, saves it and rebuilds the table.
+// Returns false when the point list is full.
+bool addCalibrationPoint(uint16_t code, uint16_t dmv);
+
+// Drops all user points (back to eFuse-only conversion)
+void clearCalibrationPoints();
+
+size_t calibrationPointCount();
+const CalPoint& calibrationPoint(size_t i);  // Sorted by code
+
+// Where the eFuse characterization came from ("eFuse two-point", ...)
+const char* calibrationSource();
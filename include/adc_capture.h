@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <driver/adc.h>
+
+// ==================== ADC CONTINUOUS (DMA) CAPTURE ====================
+// High-rate capture on one ADC1 channel using the IDF continuous-mode driver.
+// The DMA engine converts into the driver's ring buffer; readAdcCapture()
+// pulls one interrupt's worth of conversions straight into a CaptureBlock,
+// which is then handed down the pipeline by pointer.
+
+const size_t CAPTURE_BLOCK_SAMPLES = 256;  // Conversions per DMA interrupt / block
+
+struct CaptureBlock {
+  uint32_t firstIndex;  // Index of codes[0] since capture start (after decimation)
+  uint16_t count;       // Valid entries in codes[]
+  uint8_t dacCode;      // DAC code while this block was captured
+  uint16_t codes[CAPTURE_BLOCK_SAMPLES];  // 12-bit ADC codes
+};
+
+// Configures and starts continuous conversion. Returns false if the driver refused.
+bool beginAdcCapture(adc1_channel_t channel, uint32_t sampleRateHz);
+
+// Fills block.codes/count with the next conversions (raw, full rate).
+// Returns false on timeout or driver error.
+bool readAdcCapture(CaptureBlock& block, uint32_t timeoutMs);
+
+// Boxcar-decimates block.codes in place by 2^shift. A trailing partial
+// group is carried into the next block, so groups span block boundaries.
+void decimateCaptureBlock(CaptureBlock& block, uint8_t shift);
+
+// Drops a carried partial group (done by beginAdcCapture())
+void resetCaptureDecimation();
+
+void endAdcCapture();
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+// ==================== FAST BOOT STATE ====================
+// The few values needed to put the station back the way it was after a
+// reset or brown-out, kept in NVS (no file system involved): the setpoint
+// output, closed-loop target and whether a timer run was logging (only
+// once its step was applied: the schedule is not kept). setup() drives
+// the DAC and restarts sampling from this before the file system is
+// mounted; the storage task mounts, reopens the run and catches up on the
+// samples queued in RAM meanwhile.
+// The run only continues when the time the station was down is known:
+// the run clock ties run time to the RTC timer (gettimeofday()), which
+// with its RTC memory record survives software, panic and watchdog
+// resets but not a power cut. Otherwise the samples go to a new run
+// rather than being spliced onto the old run's time base.
+
+// BootState::flags
+const uint8_t BOOT_LOGGING = 0x01;      // Timer run ('g' / 's') was logging, step applied
+const uint8_t BOOT_STEP_APPLIED = 0x02;
+const uint8_t BOOT_CLOSED_LOOP = 0x04;
+
+struct __attribute__((packed)) BootState {
+  uint8_t version;
+  uint8_t flags;
+  uint8_t dacCode;           // Setpoint output
+  uint8_t reserved;
+  uint16_t controlTarget;    // Closed-loop target [0.1 mV]
+  uint16_t reserved2;
+};
+
+// False if nothing (or an older layout) is stored
+bool loadBootState(BootState& state);
+
+// Writes to NVS only if `state` differs from what is stored
+void saveBootState(const BootState& state);
+
+// Run time `runTimeMs` of run `runId` is now
+void setRunClock(uint16_t runId, uint32_t runTimeMs);
+
+// The run and its current run time, from before the reset; false after a
+// power-on or brown-out reset, or if no run clock was set
+bool readRunClock(uint16_t& runId, uint32_t& runTimeMs);
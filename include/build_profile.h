@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stddef.h>
+
+// ==================== BUILD PROFILES ====================
+// RAM sizing of the sampling and storage pipeline, fixed at compile time.
+// Every ring, pool and export buffer is a static array of these sizes, so
+// nothing on the sampling, logging or export path touches the heap.
+// Pick a profile in build_flags:
+//   -DSTATION_PROFILE_LEAN      small buffers (leaves RAM to Wi-Fi / TLS)
+//   -DSTATION_PROFILE_STANDARD  default
+//   -DSTATION_PROFILE_DEEP      deeper queues for slow flash or long bursts
+// and override single sizes with -DSTATION_<NAME>=<n>, e.g.
+// -DSTATION_ACQUISITION_QUEUE_SIZE=1024. Rings and pools must stay powers
+// of two (static_assert in sample_ring.h).
+
+#if defined(STATION_PROFILE_LEAN)
+#define STATION_PROFILE_NAME "lean"
+#define STATION_PROFILE_SAMPLE_BUFFER 64
+#define STATION_PROFILE_QUEUE 128
+#define STATION_PROFILE_CAPTURE_BLOCKS 4
+#define STATION_PROFILE_CHANNEL_BLOCKS 2
+#define STATION_PROFILE_PRETRIGGER 512
+#define STATION_PROFILE_CHUNK 1024
+#define STATION_PROFILE_IDENTIFY 64
+#elif defined(STATION_PROFILE_DEEP)
+#define STATION_PROFILE_NAME "deep"
+#define STATION_PROFILE_SAMPLE_BUFFER 256
+#define STATION_PROFILE_QUEUE 1024
+#define STATION_PROFILE_CAPTURE_BLOCKS 16
+#define STATION_PROFILE_CHANNEL_BLOCKS 8
+#define STATION_PROFILE_PRETRIGGER 8192
+#define STATION_PROFILE_CHUNK 4096
+#define STATION_PROFILE_IDENTIFY 1024
+#else
+#define STATION_PROFILE_NAME "standard"
+#define STATION_PROFILE_SAMPLE_BUFFER 128
+#define STATION_PROFILE_QUEUE 256
+#define STATION_PROFILE_CAPTURE_BLOCKS 8
+#define STATION_PROFILE_CHANNEL_BLOCKS 4
+#define STATION_PROFILE_PRETRIGGER 2048
+#define STATION_PROFILE_CHUNK 4096
+#define STATION_PROFILE_IDENTIFY 256
+#endif
+
+#ifndef STATION_SAMPLE_BUFFER_SIZE
+#define STATION_SAMPLE_BUFFER_SIZE STATION_PROFILE_SAMPLE_BUFFER
+#endif
+#ifndef STATION_ACQUISITION_QUEUE_SIZE
+#define STATION_ACQUISITION_QUEUE_SIZE STATION_PROFILE_QUEUE
+#endif
+#ifndef STATION_CAPTURE_POOL_BLOCKS
+#define STATION_CAPTURE_POOL_BLOCKS STATION_PROFILE_CAPTURE_BLOCKS
+#endif
+#ifndef STATION_CHANNEL_POOL_BLOCKS
+#define STATION_CHANNEL_POOL_BLOCKS STATION_PROFILE_CHANNEL_BLOCKS
+#endif
+#ifndef STATION_PRETRIGGER_CAPACITY
+#define STATION_PRETRIGGER_CAPACITY STATION_PROFILE_PRETRIGGER
+#endif
+#ifndef STATION_DUMP_CHUNK_SIZE
+#define STATION_DUMP_CHUNK_SIZE STATION_PROFILE_CHUNK
+#endif
+#ifndef STATION_IDENTIFY_QUEUE_SIZE
+#define STATION_IDENTIFY_QUEUE_SIZE STATION_PROFILE_IDENTIFY
+#endif
+
+const char* const BUILD_PROFILE_NAME = STATION_PROFILE_NAME;
+
+constexpr size_t PROFILE_SAMPLE_BUFFER_SIZE = STATION_SAMPLE_BUFFER_SIZE;
+constexpr size_t PROFILE_ACQUISITION_QUEUE_SIZE = STATION_ACQUISITION_QUEUE_SIZE;
+constexpr size_t PROFILE_CAPTURE_POOL_BLOCKS = STATION_CAPTURE_POOL_BLOCKS;
+constexpr size_t PROFILE_CHANNEL_POOL_BLOCKS = STATION_CHANNEL_POOL_BLOCKS;
+constexpr size_t PROFILE_PRETRIGGER_CAPACITY = STATION_PRETRIGGER_CAPACITY;
+constexpr size_t PROFILE_DUMP_CHUNK_SIZE = STATION_DUMP_CHUNK_SIZE;
+constexpr size_t PROFILE_IDENTIFY_QUEUE_SIZE = STATION_IDENTIFY_QUEUE_SIZE;
+
+static_assert(PROFILE_SAMPLE_BUFFER_SIZE >= 16, "Sample buffer too small to flush in blocks");
+static_assert(PROFILE_ACQUISITION_QUEUE_SIZE >= PROFILE_SAMPLE_BUFFER_SIZE / 2,
+              "Acquisition queue should ride out at least half a sample buffer flush");
+static_assert(PROFILE_DUMP_CHUNK_SIZE >= 512, "Export chunk must hold a frame of rows");
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// ==================== AUXILIARY CHANNEL BLOCKS ====================
+// Extra sensor channels (thermocouple amplifiers, ...) recorded next to a
+// run's main LogRecord stream. Channel c is read on every timer tick that
+// is a multiple of decimation[c], so each channel has its own rate. A run
+// keeps them in one file /rNNNN_ch.bin: a ChannelFileHeader, then
+// CHANNEL_BLOCK_SIZE blocks laid out structure-of-arrays:
+//
+//   ChannelBlockHeader | codes of channel 0 | codes of channel 1 | ...
+//
+// The array offsets are fixed for the whole run (ChannelLayout), so a
+// block is filled with plain stores and more channels add 2 bytes per
+// channel sample, nothing per tick.
+
+const uint32_t CHANNEL_MAGIC = 0x48434C54;  // "TLCH" little-endian
+const uint16_t CHANNEL_FORMAT_VERSION = 1;
+const size_t MAX_AUX_CHANNELS = 4;
+const size_t CHANNEL_BLOCK_SIZE = 512;
+const uint32_t CHANNEL_MAX_BLOCK_TICKS = 65535;
+
+struct __attribute__((packed)) ChannelFileHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint8_t channelCount;
+  uint8_t reserved;
+  uint32_t samplingIntervalUs;            // One tick, as in the run's LogFileHeader
+  uint8_t pins[MAX_AUX_CHANNELS];         // GPIO of each channel
+  uint16_t decimation[MAX_AUX_CHANNELS];  // Channel c is read on ticks divisible by this
+};
+
+struct __attribute__((packed)) ChannelBlockHeader {
+  uint32_t firstTick;   // Tick (since logging started) of the first tick covered
+  uint16_t ticks;       // Consecutive ticks covered, 0 = unused block
+  uint8_t dacCode;      // Second actuator (DAC 2) code throughout the block
+  uint8_t reserved;
+};
+
+static_assert(sizeof(ChannelFileHeader) == 24, "ChannelFileHeader layout changed");
+static_assert(sizeof(ChannelBlockHeader) == 8, "ChannelBlockHeader layout changed");
+
+// 12-bit codes that fit after the block header
+const size_t CHANNEL_BLOCK_SLOTS = (CHANNEL_BLOCK_SIZE - sizeof(ChannelBlockHeader)) / sizeof(uint16_t);
+
+// Ticks divisible by `decimation` in [firstTick, firstTick + ticks)
+inline uint32_t channelSamplesIn(uint32_t firstTick, uint32_t ticks, uint32_t decimation) {
+  uint64_t end = (uint64_t)firstTick + ticks;
+  return (uint32_t)((end + decimation - 1) / decimation - ((uint64_t)firstTick + decimation - 1) / decimation);
+}
+
+inline ChannelFileHeader makeChannelHeader(uint32_t samplingIntervalUs) {
+  ChannelFileHeader header = {};
+  header.magic = CHANNEL_MAGIC;
+  header.version = CHANNEL_FORMAT_VERSION;
+  header.samplingIntervalUs = samplingIntervalUs;
+  return header;
+}
+
+// Where each channel's array starts in a block. A block covers at most
+// ticksPerBlock ticks: the most for which every channel's worst case
+// (ceil(ticks / decimation) samples) still fits.
+struct ChannelLayout {
+  uint32_t ticksPerBlock = 0;
+  size_t channelCount = 0;
+  uint16_t decimation[MAX_AUX_CHANNELS] = {};
+  uint16_t offset[MAX_AUX_CHANNELS] = {};  // In code slots after the block header
+
+  bool build(const ChannelFileHeader& header) {
+    ticksPerBlock = 0;
+    if (header.magic != CHANNEL_MAGIC || header.version != CHANNEL_FORMAT_VERSION) return false;
+    if (header.channelCount == 0 || header.channelCount > MAX_AUX_CHANNELS) return false;
+    channelCount = header.channelCount;
+    for (size_t c = 0; c < channelCount; c++) {
+      if (header.decimation[c] == 0) return false;
+      decimation[c] = header.decimation[c];
+    }
+
+    uint32_t low = 1;
+    uint32_t high = CHANNEL_MAX_BLOCK_TICKS;
+    while (low < high) {
+      uint32_t mid = (low + high + 1) / 2;
+      if (slotsFor(mid) <= CHANNEL_BLOCK_SLOTS) low = mid; else high = mid - 1;
+    }
+    ticksPerBlock = low;
+    size_t next = 0;
+    for (size_t c = 0; c < channelCount; c++) {
+      offset[c] = next;
+      next += capacity(c, ticksPerBlock);
+    }
+    return true;
+  }
+
+private:
+  size_t capacity(size_t c, uint32_t ticks) const { return (ticks + decimation[c] - 1) / decimation[c]; }
+
+  size_t slotsFor(uint32_t ticks) const {
+    size_t slots = 0;
+    for (size_t c = 0; c < channelCount; c++) slots += capacity(c, ticks);
+    return slots;
+  }
+};
+
+// Fills one block a tick at a time (the acquisition task's side)
+class ChannelBlockBuilder {
+public:
+  bool configure(const ChannelFileHeader& header) {
+    block = nullptr;
+    return layout.build(header);
+  }
+
+  bool configured() const { return layout.ticksPerBlock > 0; }
+  const ChannelLayout& blockLayout() const { return layout; }
+
+  void begin(uint8_t* buffer, uint32_t tick, uint8_t dacCode) {
+    block = buffer;
+    firstTick = tick;
+    ticks = 0;
+    blockDacCode = dacCode;
+    for (size_t c = 0; c < layout.channelCount; c++) counts[c] = 0;
+  }
+
+  bool active() const { return block != nullptr; }
+
+  // True if `tick` (with the actuator at `dacCode`) extends the open block
+  bool continues(uint32_t tick, uint8_t dacCode) const {
+    return block && ticks < layout.ticksPerBlock && tick == firstTick + ticks && dacCode == blockDacCode;
+  }
+
+  bool due(size_t channel, uint32_t tick) const { return tick % layout.decimation[channel] == 0; }
+
+  // Stores the reading of a due channel for the current tick
+  void put(size_t channel, uint16_t code) {
+    uint8_t* slot = block + sizeof(ChannelBlockHeader) + (layout.offset[channel] + counts[channel]++) * sizeof(uint16_t);
+    memcpy(slot, &code, sizeof(code));
+  }
+
+  // Closes the current tick; true when the block is full
+  bool endTick() { return ++ticks == layout.ticksPerBlock; }
+
+  // Writes the header, zeroes unused slots and hands the block back (nullptr if none)
+  uint8_t* finish() {
+    if (!block) return nullptr;
+    if (ticks == 0) {
+      block = nullptr;
+      return nullptr;
+    }
+    ChannelBlockHeader header = { firstTick, (uint16_t)ticks, blockDacCode, 0 };
+    memcpy(block, &header, sizeof(header));
+    for (size_t c = 0; c < layout.channelCount; c++) {
+      size_t end = c + 1 < layout.channelCount ? layout.offset[c + 1] : CHANNEL_BLOCK_SLOTS;
+      uint8_t* unused = block + sizeof(header) + (layout.offset[c] + counts[c]) * sizeof(uint16_t);
+      memset(unused, 0, (end - layout.offset[c] - counts[c]) * sizeof(uint16_t));
+    }
+    uint8_t* done = block;
+    block = nullptr;
+    return done;
+  }
+
+private:
+  ChannelLayout layout;
+  uint8_t* block = nullptr;
+  uint32_t firstTick = 0;
+  uint32_t ticks = 0;
+  uint8_t blockDacCode = 0;
+  uint16_t counts[MAX_AUX_CHANNELS] = {};
+};
+
+// Reads the arrays of one stored block
+class ChannelBlockReader {
+public:
+  // False for an unused or inconsistent block
+  bool begin(const ChannelLayout& blockLayout, const uint8_t* buffer) {
+    layout = &blockLayout;
+    block = buffer;
+    memcpy(&header, block, sizeof(header));
+    return header.ticks > 0 && header.ticks <= layout->ticksPerBlock;
+  }
+
+  const ChannelBlockHeader& blockHeader() const { return header; }
+
+  uint32_t count(size_t channel) const {
+    return channelSamplesIn(header.firstTick, header.ticks, layout->decimation[channel]);
+  }
+
+  // Tick of the i-th sample of a channel
+  uint32_t tick(size_t channel, uint32_t i) const {
+    uint32_t d = layout->decimation[channel];
+    return (uint32_t)(((uint64_t)header.firstTick + d - 1) / d * d) + i * d;
+  }
+
+  uint16_t code(size_t channel, uint32_t i) const {
+    uint16_t value;
+    memcpy(&value, block + sizeof(ChannelBlockHeader) + (layout->offset[channel] + i) * sizeof(uint16_t), sizeof(value));
+    return value;
+  }
+
+private:
+  const ChannelLayout* layout = nullptr;
+  const uint8_t* block = nullptr;
+  ChannelBlockHeader header = {};
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Consistent Overhead Byte Stuffing: removes every 0x00 from a packet so
+// 0x00 can delimit packets on a byte stream. A receiver that joins mid-
+// stream (or sees console text) resynchronizes at the next 0x00.
+
+// Worst-case encoded size of `length` bytes (delimiter not included)
+constexpr size_t cobsMaxEncodedLength(size_t length) {
+  return length + length / 254 + 1;
+}
+
+// Encodes `length` bytes into `out` (cobsMaxEncodedLength(length) bytes).
+// Returns the encoded length; the caller appends the 0x00 delimiter.
+inline size_t cobsEncode(const uint8_t* in, size_t length, uint8_t* out) {
+  size_t codeIndex = 0;
+  size_t outIndex = 1;
+  uint8_t code = 1;
+  for (size_t i = 0; i < length; i++) {
+    if (in[i] != 0) {
+      out[outIndex++] = in[i];
+      code++;
+    }
+    if (in[i] == 0 || code == 0xFF) {
+      out[codeIndex] = code;
+      code = 1;
+      codeIndex = outIndex++;
+    }
+  }
+  out[codeIndex] = code;
+  return outIndex;
+}
+
+// Decodes one packet (without its delimiter). Returns the decoded length,
+// or 0 if the input is malformed.
+inline size_t cobsDecode(const uint8_t* in, size_t length, uint8_t* out) {
+  size_t outIndex = 0;
+  size_t i = 0;
+  while (i < length) {
+    uint8_t code = in[i++];
+    if (code == 0 || i + code - 1 > length) return 0;
+    for (uint8_t j = 1; j < code; j++) out[outIndex++] = in[i++];
+    if (code != 0xFF && i < length) out[outIndex++] = 0;
+  }
+  return outIndex;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Samples stay as raw ADC/DAC codes end to end. Conversion goes through
+// constexpr tables to fixed-point volts in 0.1 mV units ("dmv"), and text
+// is produced with integer formatting, so logging, streaming and export
+// need no float or double math per sample. The one exception, the
+// double-precision step fit (step_estimator.h), is fed through a queue
+// and runs in loop(), off the sampling and storage path.
+
+const uint16_t ADC_MAX_CODE = 4095;   // 12-bit sensor ADC
+const uint8_t DAC_MAX_CODE = 255;     // 8-bit setpoint DAC
+const uint32_t FULL_SCALE_DMV = 33000; // 3.3 V reference for both converters
+const uint32_t DMV_PER_VOLT = 10000;
+
+// Code -> dmv, rounded to nearest, computed at compile time
+template <size_t N>
+struct CodeScaleTable {
+  uint16_t dmv[N];
+  constexpr CodeScaleTable() : dmv() {
+    for (size_t i = 0; i < N; i++) {
+      dmv[i] = (uint16_t)((i * FULL_SCALE_DMV + (N - 1) / 2) / (N - 1));
+    }
+  }
+};
+
+inline constexpr CodeScaleTable<ADC_MAX_CODE + 1> ADC_DMV_TABLE{};  // 8 KB in flash
+inline constexpr CodeScaleTable<DAC_MAX_CODE + 1> DAC_DMV_TABLE{};
+
+static_assert(ADC_DMV_TABLE.dmv[ADC_MAX_CODE] == FULL_SCALE_DMV, "ADC scale table end point");
+static_assert(DAC_DMV_TABLE.dmv[DAC_MAX_CODE] == FULL_SCALE_DMV, "DAC scale table end point");
+
+inline uint16_t adcCodeToDmv(uint16_t code) {
+  return ADC_DMV_TABLE.dmv[code > ADC_MAX_CODE ? ADC_MAX_CODE : code];
+}
+
+inline uint16_t dacCodeToDmv(uint8_t code) {
+  return DAC_DMV_TABLE.dmv[code];
+}
+
+// For constants and user input; clamps to 0..3.3 V
+constexpr uint32_t voltsToDmv(float volts) {
+  return volts <= 0 ? 0 : volts >= 3.3f ? FULL_SCALE_DMV : (uint32_t)(volts * DMV_PER_VOLT + 0.5f);
+}
+
+// Truncates like the original (voltage / 3.3) * 255
+constexpr uint8_t dmvToDacCode(uint32_t dmv) {
+  return dmv >= FULL_SCALE_DMV ? DAC_MAX_CODE : (uint8_t)(dmv * DAC_MAX_CODE / FULL_SCALE_DMV);
+}
+
+constexpr uint16_t dmvToAdcCode(uint32_t dmv) {
+  return dmv >= FULL_SCALE_DMV ? ADC_MAX_CODE
+                               : (uint16_t)((dmv * ADC_MAX_CODE + FULL_SCALE_DMV / 2) / FULL_SCALE_DMV);
+}
+
+// ==================== INTEGER TEXT FORMATTING ====================
+// Each writes without a terminator and returns the characters written
+
+inline size_t formatUnsigned(char* out, uint32_t value) {
+  char digits[10];
+  size_t n = 0;
+  do {
+    digits[n++] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value);
+  for (size_t i = 0; i < n; i++) out[i] = digits[n - 1 - i];
+  return n;
+}
+
+// value / 10^decimals as "I.FFF" (fraction zero-padded to `decimals` digits)
+inline size_t formatFixed(char* out, uint32_t value, uint8_t decimals) {
+  uint32_t scale = 1;
+  for (uint8_t i = 0; i < decimals; i++) scale *= 10;
+  size_t n = formatUnsigned(out, value / scale);
+  if (decimals == 0) return n;
+  out[n++] = '.';
+  uint32_t fraction = value % scale;
+  for (uint8_t i = decimals; i > 0; i--) {
+    out[n + i - 1] = (char)('0' + fraction % 10);
+    fraction /= 10;
+  }
+  return n + decimals;
+}
+
+// dmv as volts with four decimals, e.g. 17730 -> "1.7730"
+inline size_t formatDmv(char* out, uint32_t dmv) {
+  return formatFixed(out, dmv, 4);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+#include "log_format.h"
+#include "code_scaling.h"
+#include "adc_calibration.h"
+
+// CSV export shared by the console ('p') and the HTTP /data.csv download.
+// Same columns as the original text log; sensor volts are calibrated.
+
+const char* const CSV_HEADER = "timestamp_ms,setpoint_v,sensor_v";
+const size_t MAX_ROW_LENGTH = 40;  // Worst-case length of one exported CSV row
+
+// Formats one record (with trailing newline) into `row`, MAX_ROW_LENGTH
+// bytes at least. Integer only: code tables, no printf or float.
+inline size_t formatCsvRow(char* row, const LogRecord& record, bool microseconds) {
+  size_t length = formatFixed(row, record.timestamp, microseconds ? 3 : 0);
+  row[length++] = ',';
+  length += formatDmv(row + length, dacCodeToDmv(record.dacCode));
+  row[length++] = ',';
+  length += formatDmv(row + length, calibratedDmv(record.adcRaw));
+  row[length++] = '\n';
+  return length;
+}
+
+// Auxiliary channels ('channels csv'): one row per channel sample, since
+// every channel has its own rate. dac2_v is the second actuator output.
+const char* const CHANNEL_CSV_HEADER = "timestamp_ms,gpio,sensor_v,dac2_v";
+
+inline size_t formatChannelCsvRow(char* row, uint32_t timestampMs, uint8_t gpio, uint16_t adcRaw, uint8_t dacCode) {
+  size_t length = formatUnsigned(row, timestampMs);
+  row[length++] = ',';
+  length += formatUnsigned(row + length, gpio);
+  row[length++] = ',';
+  length += formatDmv(row + length, calibratedDmv(adcRaw));
+  row[length++] = ',';
+  length += formatDmv(row + length, dacCodeToDmv(dacCode));
+  row[length++] = '\n';
+  return length;
+}
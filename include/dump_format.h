@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+// Framed binary transfer used by the 'b' dump command.
+// The raw data file is sent as a sequence of frames:
+//   DumpFrameHeader, payload[length], uint32 CRC-32 of payload
+// A frame with length 0 ends the dump; its CRC field then carries the
+// CRC-32 of the whole file so the host can verify it without re-dumping.
+
+const uint32_t DUMP_FRAME_MAGIC = 0x46445354;  // "TSDF" little-endian
+
+struct __attribute__((packed)) DumpFrameHeader {
+  uint32_t magic;
+  uint16_t sequence;  // Increments per frame, wraps at 65536
+  uint16_t length;    // Payload bytes
+};
+
+static_assert(sizeof(DumpFrameHeader) == 8, "DumpFrameHeader layout changed");
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Fixed power-of-two bucket histogram of durations in microseconds.
+// Bucket 0 holds < 1 us, bucket i holds [2^(i-1), 2^i) us, the last one
+// everything longer. Recording is a count-leading-zeros and three adds,
+// cheap enough to leave on in the sampling path. One writer per histogram;
+// readers may see a sample half-recorded, which is fine for statistics.
+
+const size_t LATENCY_BUCKETS = 24;  // Last bucket starts at 2^22 us (about 4 s)
+
+class LatencyHistogram {
+public:
+  void record(uint32_t us) {
+    size_t bucket = us == 0 ? 0 : 32 - __builtin_clz(us);
+    if (bucket >= LATENCY_BUCKETS) bucket = LATENCY_BUCKETS - 1;
+    buckets[bucket]++;
+    samples++;
+    totalUs += us;
+    if (us > maxUs) maxUs = us;
+  }
+
+  void reset() {
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++) buckets[i] = 0;
+    samples = 0;
+    totalUs = 0;
+    maxUs = 0;
+  }
+
+  uint32_t count() const { return samples; }
+  uint32_t max() const { return maxUs; }
+  uint32_t mean() const { return samples ? (uint32_t)(totalUs / samples) : 0; }
+  uint32_t bucketCount(size_t i) const { return buckets[i]; }
+
+  // Exclusive upper bound of bucket i [us]
+  static uint32_t bucketLimit(size_t i) { return 1u << i; }
+
+  // Upper bound of the bucket holding the given percentile (0 if empty)
+  uint32_t percentile(uint32_t percent) const {
+    if (samples == 0) return 0;
+    uint64_t wanted = ((uint64_t)samples * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+      seen += buckets[i];
+      if (seen >= wanted) return i == LATENCY_BUCKETS - 1 ? maxUs : bucketLimit(i);
+    }
+    return maxUs;
+  }
+
+private:
+  uint32_t buckets[LATENCY_BUCKETS] = {};
+  uint32_t samples = 0;
+  uint64_t totalUs = 0;
+  uint32_t maxUs = 0;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+
+// Incremental console line assembler: feed it whatever bytes are available
+// and it reports when a CR/LF-terminated line is complete. Never waits.
+// Lines longer than the buffer are discarded whole.
+template <size_t N>
+class LineReader {
+public:
+  // Returns true when `c` completes a non-empty line; handle line(), then clear()
+  bool feed(char c) {
+    if (c == '\r' || c == '\n') {
+      bool complete = length > 0 && !overflowed;
+      buffer[length] = '\0';
+      if (!complete) clear();
+      return complete;
+    }
+    if (length + 1 < N) {
+      buffer[length++] = c;
+    } else {
+      overflowed = true;
+    }
+    return false;
+  }
+
+  // Writable so the caller can tokenize in place
+  char* line() { return buffer; }
+
+  // Characters of the line still being typed
+  size_t pending() const { return length; }
+  char first() const { return buffer[0]; }
+
+  void clear() {
+    length = 0;
+    overflowed = false;
+  }
+
+private:
+  char buffer[N];
+  size_t length = 0;
+  bool overflowed = false;
+};
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "log_format.h"
+#include "crc32.h"
+
+// ==================== COMPRESSED LOG BLOCKS ====================
+// Segments of runs flagged LOG_FLAG_COMPRESSED hold fixed-size blocks
+// instead of raw LogRecords. Block 0 of a segment carries the
+// LogFileHeader (zero padded); each later block decodes on its own:
+//   LogBlockHeader (first record in full), then one token per record:
+//     0x00-0x7F  timestamp on its usual step, setpoint unchanged,
+//                sensor delta = zigzag value of the low 7 bits (-64..63)
+//     0x80       varint zigzag(timestamp delta-of-delta),
+//                varint zigzag(sensor delta), varint zigzag(setpoint delta)
+//     0x81       varint n: n records with no change at all
+//   and zero padding after payloadBytes.
+// On slowly drifting data most records take one byte, or less in flat
+// stretches, against 7 in the raw format.
+// With LOG_FLAG_BLOCK_CRC every block ends in a LogBlockTrailer: the run
+// index of its first record and a CRC-32 of everything before the CRC.
+// A torn or unwritten block fails the CRC and is skipped, and the last
+// good block alone gives the run's record count (tail-only recovery).
+
+const size_t LOG_BLOCK_SIZE = 512;  // Divides STORAGE_SECTOR_SIZE, so blocks never straddle sectors
+
+const uint8_t LOG_TOKEN_LONG = 0x80;
+const uint8_t LOG_TOKEN_REPEAT = 0x81;
+
+struct __attribute__((packed)) LogBlockHeader {
+  uint16_t recordCount;    // Records in the block, `first` included
+  uint16_t payloadBytes;   // Token bytes after this header
+  uint32_t timestampStep;  // Delta the delta-of-delta is taken against at block start
+  LogRecord first;
+  uint8_t reserved;
+};
+
+static_assert(sizeof(LogBlockHeader) == 16, "LogBlockHeader layout changed");
+
+const size_t LOG_BLOCK_PAYLOAD = LOG_BLOCK_SIZE - sizeof(LogBlockHeader);
+
+struct __attribute__((packed)) LogBlockTrailer {
+  uint32_t firstRecord;  // Index of the block's first record within the run
+  uint32_t crc;          // CRC-32 of the block up to this field
+};
+
+const size_t LOG_SEALED_PAYLOAD = LOG_BLOCK_PAYLOAD - sizeof(LogBlockTrailer);
+
+// Adds the trailer to a finished block
+inline void sealLogBlock(uint8_t* block, uint32_t firstRecord) {
+  LogBlockTrailer trailer;
+  trailer.firstRecord = firstRecord;
+  memcpy(block + LOG_BLOCK_SIZE - sizeof(trailer), &trailer.firstRecord, sizeof(trailer.firstRecord));
+  trailer.crc = crc32Update(0, block, LOG_BLOCK_SIZE - sizeof(trailer.crc));
+  memcpy(block + LOG_BLOCK_SIZE - sizeof(trailer), &trailer, sizeof(trailer));
+}
+
+inline bool logBlockSealed(const uint8_t* block, LogBlockTrailer& trailer) {
+  memcpy(&trailer, block + LOG_BLOCK_SIZE - sizeof(trailer), sizeof(trailer));
+  return trailer.crc == crc32Update(0, block, LOG_BLOCK_SIZE - sizeof(trailer.crc));
+}
+
+inline uint64_t zigzagEncode(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+inline int64_t zigzagDecode(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+inline size_t varintLength(uint64_t value) {
+  size_t length = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    length++;
+  }
+  return length;
+}
+
+inline size_t putVarint(uint8_t* out, uint64_t value) {
+  size_t length = 0;
+  while (value >= 0x80) {
+    out[length++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[length++] = (uint8_t)value;
+  return length;
+}
+
+// Returns bytes consumed, 0 if the varint runs past `length`
+inline size_t getVarint(const uint8_t* in, size_t length, uint64_t& value) {
+  value = 0;
+  for (size_t i = 0; i < length && i < 10; i++) {
+    value |= (uint64_t)(in[i] & 0x7F) << (7 * i);
+    if ((in[i] & 0x80) == 0) return i + 1;
+  }
+  return 0;
+}
+
+// Fills one block buffer record by record
+class LogBlockEncoder {
+public:
+  // capacity: token bytes available (LOG_SEALED_PAYLOAD leaves room for a trailer)
+  void begin(uint8_t* blockBuffer, uint32_t timestampStep, size_t capacity = LOG_BLOCK_PAYLOAD) {
+    block = blockBuffer;
+    step = timestampStep;
+    limit = capacity;
+    records = 0;
+    used = 0;
+    repeats = 0;
+  }
+
+  // False when the record does not fit: finish() this block and begin another
+  bool add(const LogRecord& record) {
+    if (records == 0) {
+      first = record;
+      previous = record;
+      previousDelta = step;
+      records = 1;
+      return true;
+    }
+    if (records == UINT16_MAX) return false;
+
+    int64_t delta = (int64_t)record.timestamp - (int64_t)previous.timestamp;
+    int64_t deltaOfDelta = delta - previousDelta;
+    int32_t sensorDelta = (int32_t)record.adcRaw - (int32_t)previous.adcRaw;
+    int32_t setpointDelta = (int32_t)record.dacCode - (int32_t)previous.dacCode;
+
+    if (deltaOfDelta == 0 && sensorDelta == 0 && setpointDelta == 0) {
+      if (used + repeatCost(repeats + 1) > limit) return false;
+      repeats++;
+    } else {
+      bool shortForm = deltaOfDelta == 0 && setpointDelta == 0 && sensorDelta >= -64 && sensorDelta <= 63;
+      size_t cost = shortForm ? 1
+                              : 1 + varintLength(zigzagEncode(deltaOfDelta)) +
+                                    varintLength(zigzagEncode(sensorDelta)) +
+                                    varintLength(zigzagEncode(setpointDelta));
+      if (used + repeatCost(repeats) + cost > limit) return false;
+      flushRepeats();
+      uint8_t* out = block + sizeof(LogBlockHeader) + used;
+      if (shortForm) {
+        out[0] = (uint8_t)zigzagEncode(sensorDelta);
+      } else {
+        out[0] = LOG_TOKEN_LONG;
+        size_t n = 1;
+        n += putVarint(out + n, zigzagEncode(deltaOfDelta));
+        n += putVarint(out + n, zigzagEncode(sensorDelta));
+        n += putVarint(out + n, zigzagEncode(setpointDelta));
+      }
+      used += cost;
+    }
+    previousDelta = delta;
+    previous = record;
+    records++;
+    return true;
+  }
+
+  // Writes the header and zero padding; the buffer is then a complete block.
+  // add() may continue afterwards (a commit snapshots the open block this way).
+  void finish() {
+    flushRepeats();
+    LogBlockHeader header = {};
+    header.recordCount = records;
+    header.payloadBytes = (uint16_t)used;
+    header.timestampStep = step;
+    header.first = first;
+    memcpy(block, &header, sizeof(header));
+    memset(block + sizeof(LogBlockHeader) + used, 0, LOG_BLOCK_PAYLOAD - used);
+  }
+
+  uint16_t count() const { return records; }
+  size_t unused() const { return limit - used - repeatCost(repeats); }
+
+private:
+  static size_t repeatCost(uint32_t n) {
+    return n == 0 ? 0 : n == 1 ? 1 : 1 + varintLength(n);
+  }
+
+  void flushRepeats() {
+    if (repeats == 0) return;
+    uint8_t* out = block + sizeof(LogBlockHeader) + used;
+    if (repeats == 1) {
+      out[0] = 0x00;  // Short form with zero sensor delta
+      used += 1;
+    } else {
+      out[0] = LOG_TOKEN_REPEAT;
+      used += 1 + putVarint(out + 1, repeats);
+    }
+    repeats = 0;
+  }
+
+  uint8_t* block = nullptr;
+  uint32_t step = 0;
+  size_t limit = LOG_BLOCK_PAYLOAD;
+  LogRecord first = {};
+  LogRecord previous = {};
+  int64_t previousDelta = 0;
+  uint16_t records = 0;
+  size_t used = 0;        // Token bytes written
+  uint32_t repeats = 0;   // Unchanged records not yet written
+};
+
+// Streams the records back out of one block
+class LogBlockDecoder {
+public:
+  // False if the header is inconsistent (torn or never written)
+  bool begin(const uint8_t* blockBuffer) {
+    memcpy(&header, blockBuffer, sizeof(header));
+    payload = blockBuffer + sizeof(LogBlockHeader);
+    position = 0;
+    emitted = 0;
+    repeats = 0;
+    return header.recordCount > 0 && header.payloadBytes <= LOG_BLOCK_PAYLOAD;
+  }
+
+  bool next(LogRecord& record) {
+    if (emitted >= header.recordCount) return false;
+    if (emitted == 0) {
+      current = header.first;
+      previousDelta = header.timestampStep;
+    } else if (repeats > 0) {
+      repeats--;
+      current.timestamp += (uint32_t)previousDelta;
+    } else {
+      if (position >= header.payloadBytes) return stop();
+      uint8_t token = payload[position++];
+      int64_t deltaOfDelta = 0;
+      int64_t sensorDelta = 0;
+      int64_t setpointDelta = 0;
+      if (token < LOG_TOKEN_LONG) {
+        sensorDelta = zigzagDecode(token);
+      } else if (token == LOG_TOKEN_LONG) {
+        uint64_t value;
+        size_t n;
+        if (!(n = getVarint(payload + position, header.payloadBytes - position, value))) return stop();
+        position += n;
+        deltaOfDelta = zigzagDecode(value);
+        if (!(n = getVarint(payload + position, header.payloadBytes - position, value))) return stop();
+        position += n;
+        sensorDelta = zigzagDecode(value);
+        if (!(n = getVarint(payload + position, header.payloadBytes - position, value))) return stop();
+        position += n;
+        setpointDelta = zigzagDecode(value);
+      } else if (token == LOG_TOKEN_REPEAT) {
+        uint64_t value;
+        size_t n = getVarint(payload + position, header.payloadBytes - position, value);
+        if (n == 0 || value < 2) return stop();
+        position += n;
+        repeats = value - 1;
+      } else {
+        return stop();
+      }
+      previousDelta += deltaOfDelta;
+      current.timestamp += (uint32_t)previousDelta;
+      current.adcRaw = (uint16_t)(current.adcRaw + sensorDelta);
+      current.dacCode = (uint8_t)(current.dacCode + setpointDelta);
+    }
+    emitted++;
+    record = current;
+    return true;
+  }
+
+  const LogBlockHeader& blockHeader() const { return header; }
+
+private:
+  bool stop() {
+    emitted = header.recordCount;  // Corrupt payload: drop the rest of the block
+    return false;
+  }
+
+  LogBlockHeader header = {};
+  const uint8_t* payload = nullptr;
+  size_t position = 0;
+  uint32_t emitted = 0;
+  uint64_t repeats = 0;
+  LogRecord current = {};
+  int64_t previousDelta = 0;
+};
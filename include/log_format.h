@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+
+// Binary log layout: one LogFileHeader followed by fixed-width LogRecords.
+// Records hold raw ADC/DAC codes; conversion to volts happens on export.
+
+const uint32_t LOG_MAGIC = 0x474C5354;  // "TSLG" little-endian
+const uint16_t LOG_FORMAT_VERSION = 2;
+
+// LogFileHeader::flags
+const uint16_t LOG_FLAG_TIMESTAMP_US = 0x0001;  // Record timestamps are microseconds, not ms
+const uint16_t LOG_FLAG_COMPRESSED = 0x0002;    // Records are delta-coded in blocks (log_codec.h)
+const uint16_t LOG_FLAG_BLOCK_CRC = 0x0004;     // Compressed blocks end in a LogBlockTrailer
+const uint16_t LOG_FLAG_CHANNELS = 0x0008;      // Run has an auxiliary channel file (channel_block.h)
+const uint16_t LOG_FLAG_EVENTS = 0x0010;        // Trigger mode: records are event windows, timestamps jump between them
+const uint16_t LOG_FLAG_SUMMARY = 0x0020;       // Run has a block summary file (run_summary.h)
+
+struct __attribute__((packed)) LogFileHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t recordSize;          // sizeof(LogRecord) when the file was written
+  uint32_t samplingIntervalUs;
+  uint16_t flags;
+  uint16_t reserved;
+};
+
+struct __attribute__((packed)) LogRecord {
+  uint32_t timestamp;    // Relative to start of logging (ms, or us with LOG_FLAG_TIMESTAMP_US)
+  uint16_t adcRaw;       // 12-bit sensor ADC code
+  uint8_t dacCode;       // 8-bit setpoint DAC code
+};
+
+static_assert(sizeof(LogFileHeader) == 16, "LogFileHeader layout changed");
+static_assert(sizeof(LogRecord) == 7, "LogRecord layout changed");
+
+inline LogFileHeader makeLogHeader(uint32_t samplingIntervalUs, uint16_t flags = 0) {
+  LogFileHeader header = {};
+  header.magic = LOG_MAGIC;
+  header.version = LOG_FORMAT_VERSION;
+  header.recordSize = sizeof(LogRecord);
+  header.samplingIntervalUs = samplingIntervalUs;
+  header.flags = flags;
+  return header;
+}
+
+inline bool isValidLogHeader(const LogFileHeader& header) {
+  return header.magic == LOG_MAGIC &&
+         header.version == LOG_FORMAT_VERSION &&
+         header.recordSize == sizeof(LogRecord);
+}
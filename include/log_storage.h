@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+#include <FS.h>
+
+// ==================== STORAGE BACKEND ====================
+// Filesystem used for run segments and the run index, chosen at build time:
+//   -DLOG_STORAGE_LITTLEFS  LittleFS (default; bounded append latency)
+//   -DLOG_STORAGE_SPIFFS    SPIFFS (legacy layout)
+// Both mount the same "spiffs" data partition.
+
+#if !defined(LOG_STORAGE_LITTLEFS) && !defined(LOG_STORAGE_SPIFFS)
+#define LOG_STORAGE_LITTLEFS
+#endif
+
+// Flash erase unit; segment data is written in whole sectors of this size
+const size_t STORAGE_SECTOR_SIZE = 4096;
+
+// Mounts the filesystem, formatting it if it cannot be mounted
+bool storageBegin();
+
+fs::FS& storageFs();
+size_t storageTotalBytes();
+size_t storageUsedBytes();
+const char* storageName();
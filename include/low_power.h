@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+#include <Print.h>
+
+// ==================== LOW-POWER MONITORING ====================
+// `set sleep 1`: during timer sampling ('g', `trigger arm`) loop() puts
+// the chip into light sleep for the gap before the next sample instead of
+// spinning. The sample timer, and so the sampling rate, is unchanged:
+// sleep ends LOW_POWER_WAKE_MARGIN_US ahead of the timer's next alarm.
+// The RTC peripheral domain stays powered, so both DAC outputs hold their
+// value through every sleep. A character on the console UART also wakes
+// the chip (that first character is lost; type a key, then the command).
+
+const uint32_t LOW_POWER_MIN_SLEEP_US = 5000;     // Shorter gaps are not worth a sleep
+const uint32_t LOW_POWER_WAKE_MARGIN_US = 1500;   // Wake-up latency plus slack
+
+// Sleep configuration that holds for every sleep (DAC domain, UART wake-up)
+void beginLowPower();
+
+// Light-sleeps until LOW_POWER_WAKE_MARGIN_US before esp_timer's next
+// alarm, if that is at least LOW_POWER_MIN_SLEEP_US away. The caller
+// makes sure no flash or UART transfer is in progress. True if it slept.
+bool sleepUntilNextAlarm();
+
+void resetLowPowerStats();
+void printLowPowerStats(Print& out);
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <Print.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "log_format.h"
+
+// ==================== WI-FI DATA SERVER ====================
+// Optional (build flag -DSTATION_WIFI, and Wi-Fi credentials saved with
+// `wifi <ssid> <password>`). Runs an async HTTP server on port 80:
+//   GET /              list of stored runs
+//   GET /data.csv      latest run as CSV (?run=<id> for another one),
+//                      streamed from flash a TCP window at a time;
+//                      ?from=<s>&to=<s>&every=<n> reads only that window
+//   WS  /ws            live samples, binary, batched per message:
+//                      TelemetryHeader + LogRecord[count] (telemetry_format.h)
+// Wi-Fi and the async TCP task run on core 0; sampling stays on core 1 and
+// never waits on the network. Live batches that a slow client cannot take
+// are dropped, not queued.
+
+// fileMutex serializes flash access with the storage task and commands
+void beginNetServer(SemaphoreHandle_t fileMutex);
+
+// Saves credentials to NVS and (re)connects; an empty ssid turns Wi-Fi off
+void setWifiCredentials(const char* ssid, const char* password);
+
+// Housekeeping (dead WebSocket clients); call from loop()
+void pollNetServer();
+
+void printNetStatus(Print& out);
+
+// Wi-Fi is on (light sleep would drop the connection)
+bool netServerActive();
+
+// Offers one logged sample to WebSocket clients (any task; the batch is locked)
+void netSample(const LogRecord& record, uint16_t flags);
+
+// Sends the pending batch once it is full or old enough (any task)
+void flushNetSamples();
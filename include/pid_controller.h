@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+
+// Fixed-point PID controller (Q16.16 kp/kd, Q32.32 ki and integrator,
+// integer I/O). Measurement and target are sensor units (ADC codes or
+// calibrated 0.1 mV), output is a DAC code. Gains are given in
+// volts-per-volt so they do not depend on the converter widths.
+// Scaled to DAC codes per 0.1 mV and one 10 ms period, ki = 0.05 is about
+// 4e-6 per update: it and the integrator keep 32 fraction bits, where
+// Q16 would round it to nothing.
+// Derivative acts on the measurement (no kick on target steps) and the
+// integrator stops accumulating while the output is saturated (anti-windup).
+class PidController {
+public:
+  // kp [V/V], ki [1/s], kd [s]; periodUs is the fixed update period.
+  // adcFullScale/dacFullScale (values at 3.3 V) convert V/V gains to units-per-code.
+  // False if a nonzero gain is too small to represent (it then acts as 0).
+  bool configure(float kp, float ki, float kd, uint32_t periodUs,
+                 int32_t outMin, int32_t outMax,
+                 int32_t adcFullScale = 4095, int32_t dacFullScale = 255) {
+    double scale = (double)dacFullScale / (double)adcFullScale;
+    double dt = periodUs / 1000000.0;
+    kpQ = (int32_t)toFixed(kp * scale, 16);
+    kiQ = toFixed(ki * dt * scale, INTEGRAL_BITS);
+    kdQ = (int32_t)toFixed(kd / dt * scale, 16);
+    minOut = outMin;
+    maxOut = outMax;
+    return (kp == 0 || kpQ != 0) && (ki == 0 || kiQ != 0) && (kd == 0 || kdQ != 0);
+  }
+
+  // Bumpless start: the first update() returns approximately `output`
+  void reset(int32_t measurement, int32_t output) {
+    lastMeasurement = measurement;
+    integral = (int64_t)clamp(output) << INTEGRAL_BITS;
+  }
+
+  int32_t update(int32_t target, int32_t measurement) {
+    int32_t error = target - measurement;
+    int64_t p = (int64_t)kpQ * error;
+    int64_t d = -(int64_t)kdQ * (measurement - lastMeasurement);
+    lastMeasurement = measurement;
+
+    // Conditional integration: skip when it would push further into saturation
+    int64_t candidate = integral + kiQ * error;
+    int64_t unclamped = p + (candidate >> (INTEGRAL_BITS - 16)) + d;
+    bool highAndRising = unclamped > ((int64_t)maxOut << 16) && error > 0;
+    bool lowAndFalling = unclamped < ((int64_t)minOut << 16) && error < 0;
+    if (!highAndRising && !lowAndFalling) {
+      integral = clamp64(candidate);
+    }
+
+    int64_t total = p + (integral >> (INTEGRAL_BITS - 16)) + d;
+    return clamp((int32_t)(total >> 16));
+  }
+
+private:
+  static const int INTEGRAL_BITS = 32;  // Fraction bits of kiQ and the integrator
+
+  static int64_t toFixed(double value, int bits) {
+    return (int64_t)(value * (double)((int64_t)1 << bits) + (value >= 0 ? 0.5 : -0.5));
+  }
+
+  int32_t clamp(int32_t value) const {
+    return value < minOut ? minOut : value > maxOut ? maxOut : value;
+  }
+
+  // Integrator range: the output limits in Q32.32
+  int64_t clamp64(int64_t value) const {
+    int64_t lo = (int64_t)minOut << INTEGRAL_BITS;
+    int64_t hi = (int64_t)maxOut << INTEGRAL_BITS;
+    return value < lo ? lo : value > hi ? hi : value;
+  }
+
+  int32_t kpQ = 0;
+  int64_t kiQ = 0;
+  int32_t kdQ = 0;
+  int64_t integral = 0;
+  int32_t lastMeasurement = 0;
+  int32_t minOut = 0;
+  int32_t maxOut = 255;
+};
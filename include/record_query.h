@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include "log_format.h"
+
+// ==================== RANGE QUERIES ====================
+// A time window [from, to] of one run, optionally thinned to every n-th
+// record in it. RunReader::openAt() seeks close to `from` through the
+// run's summaries, so only the window is read; RecordQuery then drops
+// the few records before it and ends the read after `to`.
+
+struct RecordQuery {
+  uint32_t from = 0;            // Run timestamp units (ms, or us for capture runs)
+  uint32_t to = UINT32_MAX;
+  uint32_t every = 1;           // Decimation: keep the 1st, (every+1)th, ... record in the window
+  uint32_t matched = 0;         // Records seen inside the window
+  bool finished = false;        // A record past `to` was seen
+
+  // Window in seconds; toSeconds < 0 means up to the end of the run
+  void set(float fromSeconds, float toSeconds, uint32_t decimation, bool microseconds) {
+    float scale = microseconds ? 1e6f : 1e3f;
+    from = fromSeconds > 0 ? toUnits(fromSeconds * scale) : 0;
+    to = toSeconds >= 0 ? toUnits(toSeconds * scale) : UINT32_MAX;
+    every = decimation > 0 ? decimation : 1;
+    matched = 0;
+    finished = false;
+  }
+
+  bool accept(const LogRecord& record) {
+    if (record.timestamp < from) return false;
+    if (record.timestamp > to) {
+      finished = true;
+      return false;
+    }
+    return matched++ % every == 0;
+  }
+
+private:
+  static uint32_t toUnits(float value) {
+    return value >= 4294967295.0f ? UINT32_MAX : (uint32_t)(value + 0.5f);
+  }
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include "code_scaling.h"
+
+// ==================== STREAMING RUN STATISTICS ====================
+// Updated once per logged sample by the storage task, so `metrics` can
+// answer without reading the log back:
+//   - RunningStats: Welford mean/variance and extremes
+//   - StepResponseTracker: rise (10-90 %) and settling (2 % band) time of
+//     the response to the latest setpoint change. Per level of the
+//     sensor (STEP_LEVEL_SHIFT-wide bins of 0.1 mV) it keeps the first
+//     and last time the signal was there, which is O(1) per sample and
+//     enough to find both times once the final value is known.
+
+class RunningStats {
+public:
+  void reset() { *this = RunningStats(); }
+
+  void add(double value) {
+    samples++;
+    double delta = value - runningMean;
+    runningMean += delta / samples;
+    m2 += delta * (value - runningMean);
+    if (samples == 1 || value < minimum) minimum = value;
+    if (samples == 1 || value > maximum) maximum = value;
+  }
+
+  uint32_t count() const { return samples; }
+  double mean() const { return runningMean; }
+  double variance() const { return samples > 1 ? m2 / (samples - 1) : 0; }
+  double stddev() const { return sqrt(variance()); }
+  double min() const { return minimum; }
+  double max() const { return maximum; }
+
+private:
+  uint32_t samples = 0;
+  double runningMean = 0;
+  double m2 = 0;
+  double minimum = 0;
+  double maximum = 0;
+};
+
+const uint8_t STEP_LEVEL_SHIFT = 5;                              // 3.2 mV per level
+const size_t STEP_LEVELS = (FULL_SCALE_DMV >> STEP_LEVEL_SHIFT) + 1;
+const size_t STEP_FINAL_WINDOW = 64;                             // Samples averaged for the final value
+const uint32_t STEP_NOT_SEEN = UINT32_MAX;
+
+// Times are in the run's timestamp unit (ms, or us for capture runs),
+// relative to the step
+struct StepMetrics {
+  uint16_t initialDmv;     // Mean before the step
+  uint16_t finalDmv;       // Mean of the last STEP_FINAL_WINDOW samples
+  uint16_t peakDmv;        // Furthest excursion in the response direction
+  float overshootPercent;  // Of the response amplitude
+  uint32_t riseTime;       // 10 % -> 90 % of the response amplitude
+  uint32_t settlingTime;   // Until the last exit from the 2 % band
+  bool settled;            // The final window lies inside the band
+  uint32_t samples;        // Since the step
+};
+
+class StepResponseTracker {
+public:
+  void reset() {
+    baseline.reset();
+    stepped = false;
+  }
+
+  // Setpoint change at `timestamp`; samples so far form the baseline
+  void step(uint32_t timestamp) {
+    initial = baseline.count() > 0 ? (uint16_t)(baseline.mean() + 0.5) : lastDmv;
+    stepTime = timestamp;
+    stepped = true;
+    afterStep = 0;
+    highest = initial;
+    lowest = initial;
+    finalSum = 0;
+    for (size_t i = 0; i < STEP_LEVELS; i++) {
+      firstAt[i] = STEP_NOT_SEEN;
+      lastAt[i] = STEP_NOT_SEEN;
+    }
+    baseline.reset();
+  }
+
+  void add(uint32_t timestamp, uint16_t dmv) {
+    lastDmv = dmv;
+    if (!stepped) {
+      baseline.add(dmv);
+      return;
+    }
+    uint32_t t = timestamp - stepTime;
+    size_t level = levelOf(dmv);
+    if (firstAt[level] == STEP_NOT_SEEN) firstAt[level] = t;
+    lastAt[level] = t;
+    if (dmv > highest) highest = dmv;
+    if (dmv < lowest) lowest = dmv;
+
+    size_t slot = afterStep % STEP_FINAL_WINDOW;
+    if (afterStep >= STEP_FINAL_WINDOW) finalSum -= recent[slot];
+    recent[slot] = dmv;
+    finalSum += dmv;
+    afterStep++;
+  }
+
+  bool stepSeen() const { return stepped; }
+
+  // False until a step has a full final window and a response of a few levels
+  bool result(StepMetrics& out) const {
+    if (!stepped || afterStep < STEP_FINAL_WINDOW) return false;
+    uint16_t final = (uint16_t)((finalSum + STEP_FINAL_WINDOW / 2) / STEP_FINAL_WINDOW);
+    int32_t amplitude = (int32_t)final - initial;
+    bool rising = amplitude > 0;
+    if ((rising ? amplitude : -amplitude) < (int32_t)(4u << STEP_LEVEL_SHIFT)) return false;
+    uint16_t peak = rising ? highest : lowest;
+
+    out.initialDmv = initial;
+    out.finalDmv = final;
+    out.peakDmv = peak;
+    out.overshootPercent = 100.0f * ((int32_t)peak - final) / amplitude;
+    if (out.overshootPercent < 0) out.overshootPercent = 0;
+    out.samples = afterStep;
+
+    uint32_t t10 = firstReach(initial + amplitude / 10, rising);
+    uint32_t t90 = firstReach(initial + amplitude * 9 / 10, rising);
+    out.riseTime = t10 != STEP_NOT_SEEN && t90 != STEP_NOT_SEEN && t90 >= t10 ? t90 - t10 : 0;
+
+    // Last time outside final +- 2 % (at least one level either side)
+    int32_t band = (rising ? amplitude : -amplitude) / 50;
+    if (band < (1 << STEP_LEVEL_SHIFT)) band = 1 << STEP_LEVEL_SHIFT;
+    size_t low = levelOf(final > band ? final - band : 0);
+    size_t high = levelOf(final + band);
+    uint32_t lastOutside = 0;
+    bool outside = false;
+    for (size_t i = 0; i < STEP_LEVELS; i++) {
+      if (i >= low && i <= high) continue;
+      if (lastAt[i] == STEP_NOT_SEEN) continue;
+      if (!outside || lastAt[i] > lastOutside) lastOutside = lastAt[i];
+      outside = true;
+    }
+    out.settlingTime = outside ? lastOutside : 0;
+    out.settled = true;
+    for (size_t i = 0; i < STEP_FINAL_WINDOW; i++) {
+      size_t level = levelOf(recent[i]);
+      if (level < low || level > high) out.settled = false;
+    }
+    return true;
+  }
+
+private:
+  static size_t levelOf(int32_t dmv) {
+    if (dmv < 0) return 0;
+    size_t level = (size_t)dmv >> STEP_LEVEL_SHIFT;
+    return level < STEP_LEVELS ? level : STEP_LEVELS - 1;
+  }
+
+  // First time the response reached `dmv` coming from the initial value
+  uint32_t firstReach(int32_t dmv, bool rising) const {
+    size_t target = levelOf(dmv);
+    uint32_t first = STEP_NOT_SEEN;
+    for (size_t i = rising ? target : 0; i < (rising ? STEP_LEVELS : target + 1); i++) {
+      if (firstAt[i] < first) first = firstAt[i];
+    }
+    return first;
+  }
+
+  RunningStats baseline;
+  bool stepped = false;
+  uint16_t initial = 0;
+  uint16_t lastDmv = 0;
+  uint16_t highest = 0;        // Extremes since the step
+  uint16_t lowest = 0;
+  uint32_t stepTime = 0;
+  uint32_t afterStep = 0;
+  uint32_t finalSum = 0;
+  uint16_t recent[STEP_FINAL_WINDOW] = {};
+  uint32_t firstAt[STEP_LEVELS];
+  uint32_t lastAt[STEP_LEVELS];
+};
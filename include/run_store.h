@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <FS.h>
+#include "log_format.h"
+#include "log_codec.h"
+#include "channel_block.h"
+#include "run_summary.h"
+
+// ==================== SEGMENTED RUN STORE ====================
+// Each experiment ('g' / 'f') is a numbered run stored as fixed-size
+// segment files /rNNNN_SSS.bin. Every segment is a complete binary log
+// (LogFileHeader + LogRecords), so segments can be read independently.
+// Runs started with LOG_FLAG_COMPRESSED store delta-coded blocks instead
+// (log_codec.h); RunReader decodes them back to plain records.
+//
+// Power-loss safety: data reaches flash on every full sector and on each
+// commitRun(), which writes the open block to its slot without closing
+// it; later commits rewrite the same slot until the block is full, so
+// commits cost writes but no space. With LOG_FLAG_BLOCK_CRC every block
+// (and each rewrite) is CRC-sealed, so a torn write costs at most the
+// block being written; LittleFS keeps the previous copy until the flush.
+// At boot, a run left open is recounted from its last segment only (the
+// index is saved on every roll-over).
+// Runs flagged LOG_FLAG_CHANNELS also have /rNNNN_ch.bin with their
+// auxiliary channels (channel_block.h), written and committed alongside.
+// Every new run gets LOG_FLAG_SUMMARY and /rNNNN_sum.bin (run_summary.h).
+// /runs.idx holds one RunInfo per stored run so listing runs never opens
+// a data file; it is saved as /runs.idx.tmp and renamed over the old one,
+// so a reset mid-save keeps the previous index. When the partition fills,
+// whole runs are evicted oldest-first.
+
+const size_t SEGMENT_SIZE = 64 * 1024;  // Bytes per segment file (header included, multiple of the sector size)
+const size_t MAX_RUNS = 32;             // Runs tracked in the index
+
+// RunInfo::state
+const uint8_t RUN_CLOSED = 0;
+const uint8_t RUN_OPEN = 1;             // Being written; counts rebuilt at boot if still set
+
+struct __attribute__((packed)) RunInfo {
+  uint16_t runId;
+  uint16_t segmentCount;
+  uint32_t bootCount;           // Boot the run was started in
+  uint32_t startUptimeMs;       // millis() when the run was started
+  uint32_t sampleCount;
+  uint32_t samplingIntervalUs;
+  uint16_t flags;               // LogFileHeader flags shared by all segments
+  uint8_t setpointCode;         // Step setpoint DAC code
+  uint8_t state;
+};
+
+// Loads the run index and repairs runs left open by a reset
+bool beginRunStore();
+
+// Opens a new run with its first segment. Evicts old runs if space is short.
+bool startRun(uint32_t samplingIntervalUs, uint16_t flags, uint8_t setpointCode);
+
+// Reopens the latest run for appending (starts nothing if there is none)
+bool resumeRun();
+
+// Appends records to the open run, rolling to a new segment when the
+// current one is full. Returns false if storage is exhausted.
+bool appendRecords(const LogRecord* records, size_t count);
+
+// Puts everything appended so far on flash (rewrites the open block in
+// compressed runs)
+bool commitRun();
+uint32_t commitCount();          // Since boot
+uint32_t commitJournalBytes();   // Open-block bytes rewritten by commits since boot
+
+// Writes out any buffered partial sector, closes the open run and saves the index
+void closeRun();
+
+// Deletes every run and the index
+void clearAllRuns();
+
+bool runIsOpen();
+size_t runCount();
+const RunInfo& runAt(size_t i);   // 0 = oldest
+const RunInfo* latestRun();
+
+// Bytes a run occupies across its segment files (opens the last segment
+// of a closed compressed run)
+uint32_t runBytes(const RunInfo& run);
+
+// Bytes after the segment headers: what RunReader returns with decode off
+uint32_t runPayloadBytes(const RunInfo& run);
+
+void segmentPath(char* path, size_t length, uint16_t runId, uint16_t segment);
+
+// Creates the channel file of the open run (started with LOG_FLAG_CHANNELS)
+bool startChannels(const ChannelFileHeader& header);
+
+// Appends one finished CHANNEL_BLOCK_SIZE block to the open run's channel file
+bool appendChannelBlock(const uint8_t* block);
+
+// Opens a run's channel file for reading, positioned at its first block
+bool openChannelFile(const RunInfo& run, File& file, ChannelFileHeader& header);
+
+void channelPath(char* path, size_t length, uint16_t runId);
+
+// Opens a run's summary file (RunSummary records) for reading
+bool openSummaryFile(const RunInfo& run, File& file);
+
+void summaryPath(char* path, size_t length, uint16_t runId);
+
+// Index of a record at or before the first one stamped `timestamp` or
+// later (run units), found by binary search over the run's summaries;
+// 0 for runs without a summary file
+uint32_t recordAtTime(const RunInfo& run, uint32_t timestamp);
+
+// Sequential reader over all records of a run, across its segments
+class RunReader {
+public:
+  // decode = false returns a compressed run as stored (whole blocks)
+  bool open(const RunInfo& run, bool decode = true);
+  // Decoding open, positioned at most one summary (SUMMARY_RECORDS)
+  // before the first record stamped `timestamp` or later
+  bool openAt(const RunInfo& run, uint32_t timestamp);
+  size_t read(uint8_t* buffer, size_t length);  // Record bytes only (headers skipped)
+  // Positions the next read at the run's `record`-th record: raw runs by
+  // offset, sealed compressed runs by binary search over block trailers,
+  // older compressed runs by walking block headers. Decoding readers only.
+  bool seekRecord(uint32_t record);
+  void close();
+  const LogFileHeader& header() const { return fileHeader; }
+
+private:
+  bool openSegment(uint16_t segment);
+  bool findBlock(uint32_t record, uint16_t& segment, size_t& block, uint32_t& first);
+  size_t readDecoded(uint8_t* buffer, size_t length);
+
+  RunInfo info;
+  LogFileHeader fileHeader;
+  File file;
+  uint16_t segment = 0;
+  size_t segmentRemaining = 0;  // Whole-record (or whole-block) bytes left in the open segment
+  bool active = false;
+  bool decodeBlocks = false;
+  bool blockPending = false;    // decoder holds a block with records left
+  uint32_t skipRecords = 0;     // Decoded records to drop before the seek target
+  LogBlockDecoder decoder;
+  uint8_t block[LOG_BLOCK_SIZE];
+};
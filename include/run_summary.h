@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "log_format.h"
+
+// ==================== BLOCK SUMMARIES ====================
+// Every run also gets /rNNNN_sum.bin: one RunSummary per SUMMARY_RECORDS
+// consecutive records (raw codes, like the log). A host draws an overview
+// from the summaries alone and merges 2^n of them for coarser levels, so
+// the file is a multi-resolution index over the run; firstRecord and
+// firstTimestamp locate any time range in the full log.
+
+const size_t SUMMARY_RECORDS = 256;
+const uint8_t SUMMARY_MAX_LEVEL = 7;      // Coarsest merge for display: 2^7 summaries
+
+struct __attribute__((packed)) RunSummary {
+  uint32_t firstRecord;     // Index of the first summarized record in the run
+  uint32_t firstTimestamp;  // Its timestamp (run units)
+  uint16_t count;           // Records summarized, 0 = padding
+  uint16_t adcMin;
+  uint16_t adcMax;
+  uint16_t adcMean;         // Rounded
+  uint8_t dacMin;
+  uint8_t dacMax;
+  uint16_t reserved;
+};
+
+static_assert(sizeof(RunSummary) == 20, "RunSummary layout changed");
+
+class SummaryBuilder {
+public:
+  bool empty() const { return summary.count == 0; }
+  bool full() const { return summary.count == SUMMARY_RECORDS; }
+
+  // `index` is the record's position in the run
+  void add(uint32_t index, const LogRecord& record) {
+    if (summary.count == 0) {
+      summary.firstRecord = index;
+      summary.firstTimestamp = record.timestamp;
+      summary.adcMin = summary.adcMax = record.adcRaw;
+      summary.dacMin = summary.dacMax = record.dacCode;
+      adcSum = 0;
+    }
+    summary.count++;
+    adcSum += record.adcRaw;
+    if (record.adcRaw < summary.adcMin) summary.adcMin = record.adcRaw;
+    if (record.adcRaw > summary.adcMax) summary.adcMax = record.adcRaw;
+    if (record.dacCode < summary.dacMin) summary.dacMin = record.dacCode;
+    if (record.dacCode > summary.dacMax) summary.dacMax = record.dacCode;
+  }
+
+  // The summary so far; the builder starts over
+  RunSummary finish() {
+    summary.adcMean = (uint16_t)((adcSum + summary.count / 2) / summary.count);
+    RunSummary done = summary;
+    summary = RunSummary();
+    return done;
+  }
+
+private:
+  RunSummary summary = {};
+  uint32_t adcSum = 0;
+};
+
+// Folds `next` (the summary after `into`) into `into`
+inline void mergeSummary(RunSummary& into, const RunSummary& next) {
+  if (next.count == 0) return;
+  if (into.count == 0) {
+    into = next;
+    return;
+  }
+  uint32_t count = into.count + next.count;
+  into.adcMean = (uint16_t)(((uint32_t)into.adcMean * into.count + (uint32_t)next.adcMean * next.count + count / 2) / count);
+  into.count = count > UINT16_MAX ? UINT16_MAX : count;
+  if (next.adcMin < into.adcMin) into.adcMin = next.adcMin;
+  if (next.adcMax > into.adcMax) into.adcMax = next.adcMax;
+  if (next.dacMin < into.dacMin) into.dacMin = next.dacMin;
+  if (next.dacMax > into.dacMax) into.dacMax = next.dacMax;
+}
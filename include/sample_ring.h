@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+
+// Fixed-capacity FIFO held in RAM.
+// Lock-free for one producer and one consumer running concurrently
+// (e.g. a timer callback pushing and loop() popping).
+// Capacity must be a power of two so indices wrap with a mask.
+template <typename T, size_t N>
+class SampleRing {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SampleRing capacity must be a power of two");
+
+public:
+  // Producer side. Returns false (and drops the item) when the ring is full
+  bool push(const T& item) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == N) return false;
+    buffer[h & (N - 1)] = item;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false when the ring is empty
+  bool pop(T& item) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) return false;
+    item = buffer[t & (N - 1)];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Discards everything currently queued
+  void clear() { tail.store(head.load(std::memory_order_acquire), std::memory_order_release); }
+
+  size_t size() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+  bool empty() const { return size() == 0; }
+  bool full() const { return size() == N; }
+  static constexpr size_t capacity() { return N; }
+
+private:
+  T buffer[N];
+  std::atomic<size_t> head{0};  // Next slot to write (owned by producer)
+  std::atomic<size_t> tail{0};  // Next slot to read (owned by consumer)
+};
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "code_scaling.h"
+
+// ==================== SETPOINT PROFILES ====================
+// A profile is a list of segments played back to back from the start of
+// a run; every segment starts where the previous one ended:
+//   hold <V> <ms>                        jump to V, stay for ms
+//   ramp <V> <ms>                        move linearly to V over ms
+//   prbs <low V> <high V> <bit ms> <n>   2^n - 1 bit maximal-length PRBS
+// The last level is held until the test is reset. Before a test the
+// profile is compiled for its sampling period into ProfileEntry rows
+// (sample index, setpoint), one per actual change, so the sampling task
+// only compares an index per sample.
+
+const size_t PROFILE_MAX_SEGMENTS = 16;
+const size_t PROFILE_MAX_ENTRIES = 1024;  // Compiled setpoint changes per test
+const uint32_t PROFILE_MAX_SEGMENT_MS = 3600000;
+const uint8_t PROFILE_PRBS_MIN_ORDER = 2;
+const uint8_t PROFILE_PRBS_MAX_ORDER = 12;
+
+enum ProfileSegmentType : uint8_t { PROFILE_HOLD, PROFILE_RAMP, PROFILE_PRBS };
+
+struct ProfileSegment {
+  ProfileSegmentType type;
+  uint8_t prbsOrder;
+  uint16_t levelDmv;    // Hold/ramp target, PRBS low level [0.1 mV]
+  uint16_t highDmv;     // PRBS high level
+  uint32_t durationMs;  // Hold/ramp length, PRBS bit length
+};
+
+struct __attribute__((packed)) ProfileEntry {
+  uint32_t tick;  // Sample index the change is applied at
+  uint16_t dmv;   // New setpoint [0.1 mV]
+};
+
+// Galois LFSR feedback masks giving period 2^n - 1 (index = order)
+static const uint16_t PRBS_MASKS[PROFILE_PRBS_MAX_ORDER + 1] = {
+  0, 0, 0x3, 0x6, 0xC, 0x14, 0x30, 0x60, 0xB8, 0x110, 0x240, 0x500, 0xE08
+};
+
+inline uint32_t segmentLengthMs(const ProfileSegment& segment) {
+  if (segment.type != PROFILE_PRBS) return segment.durationMs;
+  return ((1u << segment.prbsOrder) - 1) * segment.durationMs;
+}
+
+class SetpointProfile {
+public:
+  void clear() { count = 0; }
+
+  bool add(const ProfileSegment& segment) {
+    if (count == PROFILE_MAX_SEGMENTS) return false;
+    segments[count++] = segment;
+    return true;
+  }
+
+  size_t segmentCount() const { return count; }
+  const ProfileSegment& segment(size_t i) const { return segments[i]; }
+
+  uint32_t lengthMs() const {
+    uint32_t total = 0;
+    for (size_t i = 0; i < count; i++) total += segmentLengthMs(segments[i]);
+    return total;
+  }
+
+  // Fills `out` with the changes away from startDmv for a run sampled every
+  // intervalUs. Each change lands on the first sample at or after its time.
+  // Returns false if the schedule needs more than maxEntries rows.
+  bool compile(uint32_t intervalUs, uint16_t startDmv, ProfileEntry* out, size_t maxEntries,
+               size_t& entries) const {
+    Builder builder = { out, maxEntries, 0, startDmv, intervalUs, true };
+    uint32_t startMs = 0;
+    for (size_t i = 0; i < count && builder.ok; i++) {
+      const ProfileSegment& segment = segments[i];
+      switch (segment.type) {
+        case PROFILE_HOLD:
+          builder.emit(startMs * 1000ULL, segment.levelDmv);
+          break;
+        case PROFILE_RAMP:
+          compileRamp(builder, segment, startMs);
+          break;
+        case PROFILE_PRBS: {
+          uint16_t state = 1;
+          uint32_t bits = (1u << segment.prbsOrder) - 1;
+          for (uint32_t bit = 0; bit < bits && builder.ok; bit++) {
+            builder.emit((startMs + (uint64_t)bit * segment.durationMs) * 1000ULL,
+                         (state & 1) ? segment.highDmv : segment.levelDmv);
+            state = (state >> 1) ^ ((state & 1) ? PRBS_MASKS[segment.prbsOrder] : 0);
+          }
+          break;
+        }
+      }
+      startMs += segmentLengthMs(segment);
+    }
+    entries = builder.used;
+    return builder.ok;
+  }
+
+private:
+  struct Builder {
+    ProfileEntry* out;
+    size_t capacity;
+    size_t used;
+    uint16_t level;  // Setpoint after the rows so far
+    uint32_t intervalUs;
+    bool ok;
+
+    void emit(uint64_t timeUs, uint16_t dmv) {
+      if (dmv == level) return;
+      uint32_t tick = (uint32_t)((timeUs + intervalUs - 1) / intervalUs);
+      level = dmv;
+      // A later change on the same sample replaces the earlier one
+      if (used > 0 && out[used - 1].tick == tick) {
+        out[used - 1].dmv = dmv;
+        return;
+      }
+      if (used == capacity) {
+        ok = false;
+        return;
+      }
+      out[used].tick = tick;
+      out[used].dmv = dmv;
+      used++;
+    }
+  };
+
+  // One row per DAC code the ramp crosses, on the first sample past the
+  // crossing, so the table stays small however long the ramp is
+  static void compileRamp(Builder& builder, const ProfileSegment& segment, uint32_t startMs) {
+    int32_t from = builder.level;
+    int32_t span = (int32_t)segment.levelDmv - from;
+    uint64_t startUs = startMs * 1000ULL;
+    uint64_t lengthUs = segment.durationMs * 1000ULL;
+    int32_t fromCode = dmvToDacCode(from);
+    int32_t toCode = dmvToDacCode(segment.levelDmv);
+    int32_t direction = toCode > fromCode ? 1 : -1;
+    for (int32_t code = fromCode + direction; code != toCode + direction && toCode != fromCode && builder.ok;
+         code += direction) {
+      // Ramp value at which the DAC output becomes `code`
+      int32_t edge = direction > 0 ? (code * (int32_t)FULL_SCALE_DMV + DAC_MAX_CODE - 1) / DAC_MAX_CODE
+                                   : ((code + 1) * (int32_t)FULL_SCALE_DMV + DAC_MAX_CODE - 1) / DAC_MAX_CODE - 1;
+      uint64_t crossUs = startUs + lengthUs * (uint64_t)((edge - from) * direction) / (uint64_t)(span * direction);
+      uint32_t tick = (uint32_t)((crossUs + builder.intervalUs - 1) / builder.intervalUs);
+      uint64_t elapsedUs = (uint64_t)tick * builder.intervalUs - startUs;
+      if (elapsedUs >= lengthUs) break;
+      builder.emit((uint64_t)tick * builder.intervalUs,
+                   (uint16_t)(from + (int64_t)span * (int64_t)elapsedUs / (int64_t)lengthUs));
+    }
+    builder.emit(startUs + lengthUs, segment.levelDmv);
+  }
+
+  ProfileSegment segments[PROFILE_MAX_SEGMENTS];
+  size_t count = 0;
+};
+
+inline bool parseProfileVolts(const char* text, uint16_t& dmv) {
+  char* end;
+  float volts = strtof(text, &end);
+  if (end == text || *end != '\0' || volts < 0 || volts > 3.3f) return false;
+  dmv = (uint16_t)voltsToDmv(volts);
+  return true;
+}
+
+inline bool parseProfileMs(const char* text, uint32_t& ms) {
+  char* end;
+  unsigned long value = strtoul(text, &end, 10);
+  if (end == text || *end != '\0' || value == 0 || value > PROFILE_MAX_SEGMENT_MS) return false;
+  ms = value;
+  return true;
+}
+
+// Parses one segment from its words ("hold 1.5 3000", ...); false on bad syntax
+inline bool parseProfileSegment(const char* const* words, size_t count, ProfileSegment& segment) {
+  memset(&segment, 0, sizeof(segment));
+  if (count == 3 && (strcasecmp(words[0], "hold") == 0 || strcasecmp(words[0], "ramp") == 0)) {
+    segment.type = strcasecmp(words[0], "hold") == 0 ? PROFILE_HOLD : PROFILE_RAMP;
+    return parseProfileVolts(words[1], segment.levelDmv) && parseProfileMs(words[2], segment.durationMs);
+  }
+  if (count == 5 && strcasecmp(words[0], "prbs") == 0) {
+    segment.type = PROFILE_PRBS;
+    char* end;
+    unsigned long order = strtoul(words[4], &end, 10);
+    if (end == words[4] || *end != '\0' || order < PROFILE_PRBS_MIN_ORDER || order > PROFILE_PRBS_MAX_ORDER) {
+      return false;
+    }
+    segment.prbsOrder = (uint8_t)order;
+    return parseProfileVolts(words[1], segment.levelDmv) && parseProfileVolts(words[2], segment.highDmv) &&
+           parseProfileMs(words[3], segment.durationMs) &&
+           segmentLengthMs(segment) <= PROFILE_MAX_SEGMENT_MS;
+  }
+  return false;
+}
+
+// Writes the segment back in the syntax parseProfileSegment() reads
+inline int formatProfileSegment(char* out, size_t length, const ProfileSegment& segment) {
+  float level = segment.levelDmv * (1.0f / DMV_PER_VOLT);
+  switch (segment.type) {
+    case PROFILE_HOLD:
+      return snprintf(out, length, "hold %.4f %lu", level, (unsigned long)segment.durationMs);
+    case PROFILE_RAMP:
+      return snprintf(out, length, "ramp %.4f %lu", level, (unsigned long)segment.durationMs);
+    case PROFILE_PRBS:
+      return snprintf(out, length, "prbs %.4f %.4f %lu %u", level, segment.highDmv * (1.0f / DMV_PER_VOLT),
+                      (unsigned long)segment.durationMs, segment.prbsOrder);
+  }
+  return 0;
+}
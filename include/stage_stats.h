@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <Print.h>
+#include <esp_cpu.h>
+#include "latency_histogram.h"
+
+// ==================== HOT-PATH STATS ====================
+// Per-stage latency histograms, timed with the CPU cycle counter (CCOUNT)
+// and kept in RAM; `stats` prints them, `stats reset` clears them. Always
+// on: a stage costs two CCOUNT reads and one histogram update. Start and
+// end of a stage must run on the same core (CCOUNT is per core), which
+// holds for every pinned task here.
+
+enum Stage : uint8_t {
+  STAGE_SAMPLE_WAKE,     // Sample timer fired -> acquisition task running
+  STAGE_SAMPLE_JITTER,   // |sample-to-sample period - sampling interval|
+  STAGE_ADC_READ,        // One oversampled sensor reading
+  STAGE_CONTROL,         // One PID period (read + update + DAC write)
+  STAGE_STORAGE_PASS,    // One storage task wake-up under the mutex
+  STAGE_FLASH_APPEND,    // appendRecords() (sector writes, segment roll-over)
+  STAGE_SERIAL_OUTPUT,   // Progress line or telemetry flush
+  STAGE_COMMAND,         // One console command, start to finish
+  STAGE_COUNT
+};
+
+inline uint32_t stageStart() { return esp_cpu_get_ccount(); }
+
+// Records the cycles since `start` (from stageStart()) under `stage`
+void stageEnd(Stage stage, uint32_t start);
+
+// Records an already measured duration
+void stageRecordUs(Stage stage, uint32_t us);
+
+// A sample started or finished after its sampling interval had run out
+void noteMissedDeadline();
+uint32_t missedDeadlines();
+
+// Caches the CPU clock for cycle -> us conversion and clears everything
+void beginStageStats();
+void resetStageStats();
+
+// Heap watermark: free heap once the boot is done (storage mounted, run
+// reopened) against the free heap now and the allocator's own all-time
+// low (heap_caps_get_minimum_free_size(), which catches transients between
+// any two checks). Sampling and logging use static buffers, but
+// Print::printf() allocates for lines over 64 bytes and the Wi-Fi stack
+// and HTTP handlers allocate per request, so the low mark dips below the
+// boot level by design. A leak shows as free heap that stays below the
+// boot level and keeps falling.
+void beginHeapWatch();
+
+void printStageStats(Print& out, uint32_t samplingIntervalMs);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <Print.h>
+#include "channel_block.h"
+
+// ==================== RUNTIME CONFIGURATION ====================
+// Test parameters that used to be compile-time constants. Each one is a
+// named entry in a table (for `set`/`show`) and an NVS key in the
+// Preferences namespace "station", so tuning survives a reboot without a
+// reflash. The compile-time constants in main.cpp are only the defaults.
+
+struct StationConfig {
+  uint32_t samplingIntervalMs;  // Timer sampling period ('g')
+  uint32_t initialWaitMs;       // Baseline time before the step
+  float baseVoltage;            // Setpoint before the step / after reset [V]
+  float stepVoltage;            // Setpoint after the step [V]
+  float kp;                     // PID gains (see pid_controller.h)
+  float ki;
+  float kd;
+  uint8_t oversampleShift;      // 2^shift ADC reads per sample
+  uint16_t streamDecimation;    // Live telemetry: every Nth sample, 0 = off
+  uint8_t compressLog;          // 1 = new runs are stored delta-coded (log_codec.h)
+  uint32_t commitIntervalMs;    // Log data older than this is on flash, 0 = full sectors only
+  uint16_t auxDecimation[MAX_AUX_CHANNELS];  // Auxiliary channel read every Nth tick, 0 = off
+  float auxDacVoltage;          // Second actuator output (DAC 2) [V]
+  uint32_t preTriggerMs;        // Trigger mode: history kept ahead of an event
+  uint32_t postTriggerMs;       // Trigger mode: logged after the last event
+  float triggerSlopeMvPerS;     // Trigger on |sensor slope| above this, 0 = off
+  uint8_t triggerOnSetpoint;    // 1 = trigger on every setpoint change
+  uint8_t lowPower;             // 1 = light sleep between timer samples (low_power.h)
+  uint8_t singleKeys;           // 1 = r/i/v/h/+/- also run without a line ending
+};
+
+enum ConfigStatus {
+  CONFIG_OK,
+  CONFIG_UNKNOWN,   // No parameter with that name
+  CONFIG_INVALID,   // Not a number or out of range
+  CONFIG_LOCKED,    // Cannot change while a test is running
+};
+
+extern StationConfig config;
+
+// Starts from `defaults` and overlays any values saved in NVS
+void beginConfig(const StationConfig& defaults);
+
+// Validates every name/value pair, then applies and saves them together;
+// nothing changes if any pair fails (*failed names the offending one)
+ConfigStatus setConfigValues(const char* const* names, const char* const* values, size_t count,
+                             bool testRunning, const char** failed);
+
+// Back to the compile-time defaults and drops the saved values
+void resetConfig();
+
+void printConfig(Print& out);
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+// Streaming FOPDT identification of a step response:
+//   G(s) = K e^(-theta s) / (tau s + 1)
+// For t > theta after a step of size du, integrating the model once gives
+//   I(t) = K du t - K du theta - tau Y(t),   Y = y - y0,  I = integral of Y
+// which is linear in (K du, K du theta, tau). Each sample adds to the
+// least-squares normal equations, so nothing is stored per sample and the
+// fit can be read at any time while the response is still settling.
+
+struct StepFit {
+  float gain;          // K [output V / input V]
+  float timeConstant;  // tau [s]
+  float deadTime;      // theta [s]
+  float baseline;      // y0 before the step [V]
+  float stepSize;      // du [V]
+  uint32_t samples;    // Samples in the regression
+};
+
+class StepEstimator {
+public:
+  void reset() { *this = StepEstimator(); }
+
+  // t in seconds, y sensor volts, u setpoint volts. Samples before the
+  // input changes form the baseline; a second input change freezes the fit.
+  void addSample(double t, double y, double u) {
+    if (frozen) return;
+    if (baselineCount == 0 && !stepped) {
+      u0 = u;
+    }
+    if (!stepped) {
+      if (fabs(u - u0) <= INPUT_EPSILON) {
+        addBaseline(y);
+        return;
+      }
+      if (baselineCount == 0) {  // Step without a baseline: nothing to reference
+        frozen = true;
+        return;
+      }
+      stepped = true;
+      t0 = t;
+      du = u - u0;
+      uStep = u;
+      lastY = y - baselineMean;
+      lastT = 0;
+      double sigma = baselineCount > 1 ? sqrt(baselineM2 / (baselineCount - 1)) : 0;
+      threshold = fmax(NOISE_SIGMAS * sigma, MIN_THRESHOLD_V);
+    } else if (fabs(u - uStep) > INPUT_EPSILON) {
+      frozen = true;
+      return;
+    }
+
+    // Trapezoidal running integral of the deviation from baseline
+    double tr = t - t0;
+    double dev = y - baselineMean;
+    integral += 0.5 * (dev + lastY) * (tr - lastT);
+    lastY = dev;
+    lastT = tr;
+
+    // Only fit once the output has left the noise band (t > theta)
+    if (!responding && fabs(dev) < threshold) return;
+    responding = true;
+
+    double x[3] = { tr, 1.0, dev };
+    for (int i = 0; i < 3; i++) {
+      for (int j = i; j < 3; j++) xx[i][j] += x[i] * x[j];
+      xi[i] += x[i] * integral;
+    }
+    count++;
+  }
+
+  // False until enough samples have left the noise band for a solvable fit
+  bool result(StepFit& fit) const {
+    if (!stepped || count < MIN_FIT_SAMPLES || du == 0) return false;
+
+    double a[3][3];
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) a[i][j] = j >= i ? xx[i][j] : xx[j][i];
+    }
+    double det = det3(a);
+    if (fabs(det) < 1e-12) return false;
+
+    // Cramer's rule on the 3x3 normal equations
+    double p[3];
+    for (int k = 0; k < 3; k++) {
+      double m[3][3];
+      for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) m[i][j] = j == k ? xi[i] : a[i][j];
+      }
+      p[k] = det3(m) / det;
+    }
+    if (p[0] == 0) return false;
+
+    fit.gain = (float)(p[0] / du);
+    fit.deadTime = (float)(-p[1] / p[0]);
+    fit.timeConstant = (float)(-p[2]);
+    fit.baseline = (float)baselineMean;
+    fit.stepSize = (float)du;
+    fit.samples = count;
+    return fit.timeConstant > 0;
+  }
+
+  bool stepSeen() const { return stepped; }
+  bool isFrozen() const { return frozen; }
+
+private:
+  static constexpr double INPUT_EPSILON = 1e-4;    // Volts; below one DAC code
+  static constexpr double NOISE_SIGMAS = 4.0;
+  static constexpr double MIN_THRESHOLD_V = 0.002; // About 2.5 ADC codes
+  static const uint32_t MIN_FIT_SAMPLES = 8;
+
+  static double det3(const double m[3][3]) {
+    return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+           m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+           m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+  }
+
+  // Welford running mean/variance of the pre-step output
+  void addBaseline(double y) {
+    baselineCount++;
+    double delta = y - baselineMean;
+    baselineMean += delta / baselineCount;
+    baselineM2 += delta * (y - baselineMean);
+  }
+
+  uint32_t baselineCount = 0;
+  double baselineMean = 0;
+  double baselineM2 = 0;
+  double u0 = 0;
+  double uStep = 0;
+  double du = 0;
+  double t0 = 0;
+  double threshold = 0;
+  double integral = 0;
+  double lastY = 0;
+  double lastT = 0;
+  double xx[3][3] = {};  // Upper triangle of X^T X
+  double xi[3] = {};     // X^T I
+  uint32_t count = 0;
+  bool stepped = false;
+  bool responding = false;
+  bool frozen = false;
+};
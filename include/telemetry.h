@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "log_format.h"
+
+// ==================== LIVE TELEMETRY ====================
+// Streams every Nth sample as COBS-framed binary packets (telemetry_format.h)
+// on the console UART. Packets go into the UART driver's TX ring buffer,
+// which the driver's interrupt moves into the hardware FIFO, so a packet is
+// never waited on: if the buffer is too full, the packet is dropped and
+// counted. Samples are batched per packet to keep the framing overhead low.
+
+const size_t TELEMETRY_TX_BUFFER_SIZE = 8192;  // UART TX ring (set before Serial.begin)
+const size_t TELEMETRY_BATCH_RECORDS = 16;     // Records per packet at most
+
+// 0 stops the stream; N sends every Nth sample. A change resets the sequence.
+// Safe from any task: it takes effect at the next telemetryEnabled().
+void setTelemetryDecimation(uint16_t decimation);
+
+// Call before each group of samples, from the task feeding the stream
+// (the batch and counters belong to it); applies a pending decimation
+bool telemetryEnabled();
+
+// Offers one logged sample; `flags` are the run's LogFileHeader flags
+void telemetrySample(const LogRecord& record, uint16_t flags);
+
+// Sends the partial batch (call after each group of samples)
+void flushTelemetry();
+
+uint32_t telemetryPacketsSent();
+uint32_t telemetryPacketsDropped();
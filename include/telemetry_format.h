@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+#include "log_format.h"
+
+// Live telemetry packets (see telemetry.h). On the wire each packet is
+//   COBS( TelemetryHeader, LogRecord[count], uint32 CRC-32 ) 0x00
+// The CRC-32 (crc32.h) covers the header and records. Records use the
+// same 7-byte layout as the binary log, and sequence numbers let the host
+// count lost packets.
+
+const uint8_t TELEMETRY_SAMPLES = 0x01;   // TelemetryHeader::type
+
+struct __attribute__((packed)) TelemetryHeader {
+  uint8_t type;
+  uint8_t flags;       // LogFileHeader flags (LOG_FLAG_TIMESTAMP_US)
+  uint16_t sequence;   // Increments per packet, wraps at 65536
+  uint8_t count;       // LogRecords that follow
+};
+
+static_assert(sizeof(TelemetryHeader) == 5, "TelemetryHeader layout changed");
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ==================== EVENT TRIGGER ====================
+// Conditions for trigger mode (`trigger arm`), evaluated once per sample
+// in O(1):
+//   - slope: the mean of the last TRIGGER_HALF_WINDOW sensor values minus
+//     the mean of the TRIGGER_HALF_WINDOW before them, i.e. the sensor
+//     slope smoothed over 2 * TRIGGER_HALF_WINDOW samples, against a limit
+//   - setpoint: any change of the setpoint between two samples
+
+const size_t TRIGGER_HALF_WINDOW = 16;
+
+enum TriggerCause : uint8_t {
+  TRIGGER_NONE,
+  TRIGGER_SLOPE,
+  TRIGGER_SETPOINT,
+  TRIGGER_MANUAL,
+};
+
+inline const char* triggerCauseName(TriggerCause cause) {
+  switch (cause) {
+    case TRIGGER_SLOPE:    return "slope";
+    case TRIGGER_SETPOINT: return "setpoint";
+    case TRIGGER_MANUAL:   return "manual";
+    default:               return "none";
+  }
+}
+
+class TriggerDetector {
+public:
+  // slopeMvPerS = 0 disables the slope condition
+  void configure(float slopeMvPerS, uint32_t samplingIntervalUs, bool onSetpoint) {
+    // Both half-window sums are TRIGGER_HALF_WINDOW samples apart, so their
+    // difference is slope [0.1 mV/sample] * TRIGGER_HALF_WINDOW^2
+    float dmvPerSample = slopeMvPerS * 10.0f * samplingIntervalUs * 1e-6f;
+    sumLimit = slopeMvPerS > 0 ? (int32_t)(dmvPerSample * TRIGGER_HALF_WINDOW * TRIGGER_HALF_WINDOW + 0.5f) : 0;
+    if (slopeMvPerS > 0 && sumLimit < 1) sumLimit = 1;
+    setpointTrigger = onSetpoint;
+    reset();
+  }
+
+  void reset() {
+    filled = 0;
+    position = 0;
+    newSum = 0;
+    oldSum = 0;
+    haveSetpoint = false;
+  }
+
+  // One sample: calibrated sensor and setpoint [0.1 mV]. Returns the cause if a condition fires.
+  TriggerCause update(uint16_t sensorDmv, uint16_t setpointDmv) {
+    TriggerCause cause = TRIGGER_NONE;
+    if (setpointTrigger && haveSetpoint && setpointDmv != lastSetpoint) cause = TRIGGER_SETPOINT;
+    lastSetpoint = setpointDmv;
+    haveSetpoint = true;
+
+    // history[position] is the oldest value (2 half windows back) once full
+    const size_t window = 2 * TRIGGER_HALF_WINDOW;
+    if (filled == window) oldSum -= history[position];
+    if (filled >= TRIGGER_HALF_WINDOW) {
+      uint16_t moving = history[(position + TRIGGER_HALF_WINDOW) % window];
+      newSum -= moving;
+      oldSum += moving;
+    }
+    history[position] = sensorDmv;
+    newSum += sensorDmv;
+    position = (position + 1) % window;
+    if (filled < window) filled++;
+
+    if (cause == TRIGGER_NONE && sumLimit > 0 && filled == window) {
+      int32_t difference = newSum - oldSum;
+      if (difference >= sumLimit || -difference >= sumLimit) cause = TRIGGER_SLOPE;
+    }
+    return cause;
+  }
+
+private:
+  uint16_t history[2 * TRIGGER_HALF_WINDOW] = {};
+  size_t filled = 0;
+  size_t position = 0;
+  int32_t newSum = 0;       // Last TRIGGER_HALF_WINDOW values
+  int32_t oldSum = 0;       // The TRIGGER_HALF_WINDOW before those
+  int32_t sumLimit = 0;     // 0 = slope condition off
+  bool setpointTrigger = false;
+  bool haveSetpoint = false;
+  uint16_t lastSetpoint = 0;
+};
@@ -0,0 +1,116 @@
+#include "adc_calibration.h"
+#include <esp_adc_cal.h>
+#include <Preferences.h>
+
+// Points closer than this (in raw codes) replace each other
+const uint16_t CAL_POINT_MERGE_CODES = 16;
+
+uint16_t adcCalTable[ADC_MAX_CODE + 1];
+
+static esp_adc_cal_characteristics_t characteristics;
+static esp_adc_cal_value_t characterization = ESP_ADC_CAL_VAL_DEFAULT_VREF;
+static CalPoint points[MAX_CAL_POINTS];
+static size_t pointCount = 0;
+
+// eFuse-characterized conversion in 0.1 mV (esp_adc_cal works in mV)
+static int32_t characterizedDmv(uint16_t code) {
+  return (int32_t)esp_adc_cal_raw_to_voltage(code, &characteristics) * 10;
+}
+
+// User correction (reference - characterized) at `code`, linear between points
+static int32_t correctionAt(uint16_t code, const int32_t* offsets) {
+  if (pointCount == 1) return offsets[0];
+
+  size_t upper = 1;
+  while (upper < pointCount - 1 && code > points[upper].code) upper++;
+  const CalPoint& a = points[upper - 1];
+  const CalPoint& b = points[upper];
+  int32_t span = (int32_t)b.code - (int32_t)a.code;
+  if (span <= 0) return offsets[upper];
+  return offsets[upper - 1] + (offsets[upper] - offsets[upper - 1]) * ((int32_t)code - a.code) / span;
+}
+
+static void buildTable() {
+  int32_t offsets[MAX_CAL_POINTS];
+  for (size_t i = 0; i < pointCount; i++) {
+    offsets[i] = (int32_t)points[i].dmv - characterizedDmv(points[i].code);
+  }
+
+  for (uint32_t code = 0; code <= ADC_MAX_CODE; code++) {
+    int32_t dmv = characterizedDmv(code);
+    if (pointCount > 0) dmv += correctionAt(code, offsets);
+    if (dmv < 0) dmv = 0;
+    if (dmv > (int32_t)FULL_SCALE_DMV) dmv = FULL_SCALE_DMV;
+    adcCalTable[code] = (uint16_t)dmv;
+  }
+}
+
+static void savePoints() {
+  Preferences prefs;
+  if (prefs.begin("station", false)) {
+    if (pointCount > 0) {
+      prefs.putBytes("adccal", points, pointCount * sizeof(CalPoint));
+    } else {
+      prefs.remove("adccal");
+    }
+    prefs.end();
+  }
+}
+
+static void loadPoints() {
+  pointCount = 0;
+  Preferences prefs;
+  if (prefs.begin("station", true)) {
+    size_t length = prefs.getBytesLength("adccal");
+    if (length > 0 && length % sizeof(CalPoint) == 0 && length <= sizeof(points)) {
+      pointCount = prefs.getBytes("adccal", points, length) / sizeof(CalPoint);
+    }
+    prefs.end();
+  }
+}
+
+void beginAdcCalibration() {
+  characterization = esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12,
+                                              DEFAULT_VREF_MV, &characteristics);
+  loadPoints();
+  buildTable();
+}
+
+bool addCalibrationPoint(uint16_t code, uint16_t dmv) {
+  // Replace a point at nearly the same code, otherwise insert sorted
+  size_t i = 0;
+  while (i < pointCount && points[i].code + CAL_POINT_MERGE_CODES < code) i++;
+  if (i < pointCount && points[i].code <= code + CAL_POINT_MERGE_CODES) {
+    points[i] = { code, dmv };
+  } else {
+    if (pointCount == MAX_CAL_POINTS) return false;
+    for (size_t j = pointCount; j > i; j--) points[j] = points[j - 1];
+    points[i] = { code, dmv };
+    pointCount++;
+  }
+  savePoints();
+  buildTable();
+  return true;
+}
+
+void clearCalibrationPoints() {
+  pointCount = 0;
+  savePoints();
+  buildTable();
+}
+
+size_t calibrationPointCount() {
+  return pointCount;
+}
+
+const CalPoint& calibrationPoint(size_t i) {
+  return points[i];
+}
+
+const char* calibrationSource() {
+  switch (characterization) {
+    case ESP_ADC_CAL_VAL_EFUSE_TP:   return "eFuse two-point";
+    case ESP_ADC_CAL_VAL_EFUSE_VREF: return "eFuse Vref";
+    default:                         return "default Vref";
+  }
+}
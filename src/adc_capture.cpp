@@ -0,0 +1,100 @@
+#include "adc_capture.h"
+
+// Bytes the driver may buffer internally before the oldest conversions are lost
+const uint32_t CAPTURE_DRIVER_BUFFER_BYTES = 4 * CAPTURE_BLOCK_SAMPLES * sizeof(adc_digi_output_data_t);
+
+static adc1_channel_t captureChannel;
+static bool captureRunning = false;
+static uint32_t carrySum = 0;     // Codes of a decimation group split across blocks
+static uint32_t carryCount = 0;
+
+bool beginAdcCapture(adc1_channel_t channel, uint32_t sampleRateHz) {
+  if (captureRunning) return true;
+  
+  adc_digi_init_config_t initConfig = {};
+  initConfig.max_store_buf_size = CAPTURE_DRIVER_BUFFER_BYTES;
+  initConfig.conv_num_each_intr = CAPTURE_BLOCK_SAMPLES * sizeof(adc_digi_output_data_t);
+  initConfig.adc1_chan_mask = BIT(channel);
+  initConfig.adc2_chan_mask = 0;
+  if (adc_digi_initialize(&initConfig) != ESP_OK) return false;
+  
+  adc_digi_pattern_config_t pattern = {};
+  pattern.atten = ADC_ATTEN_DB_11;
+  pattern.channel = channel;
+  pattern.unit = 0;  // ADC1
+  pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+  
+  adc_digi_configuration_t config = {};
+  config.conv_limit_en = true;   // Required on the original ESP32
+  config.conv_limit_num = 250;
+  config.pattern_num = 1;
+  config.adc_pattern = &pattern;
+  config.sample_freq_hz = sampleRateHz;
+  config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+  if (adc_digi_controller_configure(&config) != ESP_OK || adc_digi_start() != ESP_OK) {
+    adc_digi_deinitialize();
+    return false;
+  }
+  
+  captureChannel = channel;
+  captureRunning = true;
+  resetCaptureDecimation();
+  return true;
+}
+
+bool readAdcCapture(CaptureBlock& block, uint32_t timeoutMs) {
+  if (!captureRunning) return false;
+  
+  // TYPE1 output is one 16-bit word per conversion, so the driver can copy
+  // straight into codes[] and we strip the channel bits in place
+  static_assert(sizeof(adc_digi_output_data_t) == sizeof(uint16_t), "Unexpected ADC output format");
+  uint32_t bytesRead = 0;
+  esp_err_t result = adc_digi_read_bytes((uint8_t*)block.codes, sizeof(block.codes), &bytesRead, timeoutMs);
+  if (result != ESP_OK && result != ESP_ERR_INVALID_STATE) return false;  // INVALID_STATE = driver overrun, data still valid
+  
+  adc_digi_output_data_t* words = (adc_digi_output_data_t*)block.codes;
+  size_t count = bytesRead / sizeof(adc_digi_output_data_t);
+  size_t kept = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (words[i].type1.channel == captureChannel) {
+      block.codes[kept++] = words[i].type1.data;
+    }
+  }
+  block.count = kept;
+  return kept > 0;
+}
+
+// In place is safe: output n is written only after its group, which ends
+// past index n, has been read
+void decimateCaptureBlock(CaptureBlock& block, uint8_t shift) {
+  if (shift == 0) return;
+  
+  uint32_t factor = 1u << shift;
+  uint32_t sum = carrySum;
+  uint32_t count = carryCount;
+  size_t outCount = 0;
+  for (size_t i = 0; i < block.count; i++) {
+    sum += block.codes[i];
+    if (++count == factor) {
+      block.codes[outCount++] = (sum + (factor >> 1)) >> shift;
+      sum = 0;
+      count = 0;
+    }
+  }
+  carrySum = sum;
+  carryCount = count;
+  block.count = outCount;
+}
+
+void resetCaptureDecimation() {
+  carrySum = 0;
+  carryCount = 0;
+}
+
+void endAdcCapture() {
+  if (!captureRunning) return;
+  adc_digi_stop();
+  adc_digi_deinitialize();
+  captureRunning = false;
+}
@@ -0,0 +1,81 @@
+#include "boot_state.h"
+#include <Preferences.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <sys/time.h>
+#include <string.h>
+
+static const uint8_t BOOT_STATE_VERSION = 1;
+static const uint32_t RUN_CLOCK_MAGIC = 0x4B4C4352;  // "RCLK"
+
+// RTC slow memory is left alone by every reset but power-on
+struct RunClock {
+  uint32_t magic;
+  uint16_t runId;
+  uint16_t reserved;
+  int64_t originUs;   // RTC time at run time 0
+  uint32_t check;     // Tells a kept record from power-on garbage
+};
+
+RTC_NOINIT_ATTR static RunClock runClock;
+
+static BootState saved = {};
+static bool savedKnown = false;  // `saved` mirrors NVS
+
+bool loadBootState(BootState& state) {
+  Preferences prefs;
+  bool ok = false;
+  if (prefs.begin("station", true)) {
+    ok = prefs.getBytesLength("boot") == sizeof(BootState) &&
+         prefs.getBytes("boot", &state, sizeof(BootState)) == sizeof(BootState) &&
+         state.version == BOOT_STATE_VERSION;
+    prefs.end();
+  }
+  if (ok) {
+    saved = state;
+    savedKnown = true;
+  }
+  return ok;
+}
+
+void saveBootState(const BootState& state) {
+  BootState next = state;
+  next.version = BOOT_STATE_VERSION;
+  if (savedKnown && memcmp(&next, &saved, sizeof(next)) == 0) return;
+  Preferences prefs;
+  if (prefs.begin("station", false)) {
+    prefs.putBytes("boot", &next, sizeof(next));
+    prefs.end();
+    saved = next;
+    savedKnown = true;
+  }
+}
+
+static int64_t rtcClockUs() {
+  struct timeval now;
+  gettimeofday(&now, nullptr);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+static uint32_t runClockCheck(const RunClock& clock) {
+  return ~(clock.magic ^ clock.runId ^ (uint32_t)clock.originUs ^ (uint32_t)(clock.originUs >> 32));
+}
+
+void setRunClock(uint16_t runId, uint32_t runTimeMs) {
+  runClock.magic = RUN_CLOCK_MAGIC;
+  runClock.runId = runId;
+  runClock.reserved = 0;
+  runClock.originUs = rtcClockUs() - (int64_t)runTimeMs * 1000;
+  runClock.check = runClockCheck(runClock);
+}
+
+bool readRunClock(uint16_t& runId, uint32_t& runTimeMs) {
+  esp_reset_reason_t reason = esp_reset_reason();
+  if (reason == ESP_RST_POWERON || reason == ESP_RST_BROWNOUT || reason == ESP_RST_UNKNOWN) return false;
+  if (runClock.magic != RUN_CLOCK_MAGIC || runClock.check != runClockCheck(runClock)) return false;
+  int64_t elapsedMs = (rtcClockUs() - runClock.originUs) / 1000;
+  if (elapsedMs < 0 || elapsedMs > (int64_t)UINT32_MAX) return false;
+  runId = runClock.runId;
+  runTimeMs = (uint32_t)elapsedMs;
+  return true;
+}
@@ -0,0 +1,31 @@
+#include "log_storage.h"
+
+#if defined(LOG_STORAGE_LITTLEFS)
+#include <LittleFS.h>
+#define STORAGE_FS LittleFS
+#define STORAGE_NAME "LittleFS"
+#else
+#include <SPIFFS.h>
+#define STORAGE_FS SPIFFS
+#define STORAGE_NAME "SPIFFS"
+#endif
+
+bool storageBegin() {
+  return STORAGE_FS.begin(true);
+}
+
+fs::FS& storageFs() {
+  return STORAGE_FS;
+}
+
+size_t storageTotalBytes() {
+  return STORAGE_FS.totalBytes();
+}
+
+size_t storageUsedBytes() {
+  return STORAGE_FS.usedBytes();
+}
+
+const char* storageName() {
+  return STORAGE_NAME;
+}
@@ -0,0 +1,42 @@
+#include "low_power.h"
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <driver/uart.h>
+
+static uint32_t sleepCount = 0;
+static uint64_t sleptUs = 0;
+static int64_t statsSinceUs = 0;
+
+void beginLowPower() {
+  esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON);  // DACs keep driving
+  uart_set_wakeup_threshold(UART_NUM_0, 3);  // Edges on RX, i.e. one character
+  esp_sleep_enable_uart_wakeup(UART_NUM_0);
+  resetLowPowerStats();
+}
+
+bool sleepUntilNextAlarm() {
+  int64_t now = esp_timer_get_time();
+  int64_t gap = esp_timer_get_next_alarm() - now - LOW_POWER_WAKE_MARGIN_US;
+  if (gap < (int64_t)LOW_POWER_MIN_SLEEP_US) return false;
+  
+  esp_sleep_enable_timer_wakeup(gap);
+  bool slept = esp_light_sleep_start() == ESP_OK;
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+  if (slept) {
+    sleepCount++;
+    sleptUs += esp_timer_get_time() - now;
+  }
+  return slept;
+}
+
+void resetLowPowerStats() {
+  sleepCount = 0;
+  sleptUs = 0;
+  statsSinceUs = esp_timer_get_time();
+}
+
+void printLowPowerStats(Print& out) {
+  int64_t elapsed = esp_timer_get_time() - statsSinceUs;
+  out.printf("Light sleep: %lu sleeps, %.1f%% of the last %.0f s asleep\n", (unsigned long)sleepCount,
+             elapsed > 0 ? 100.0 * sleptUs / elapsed : 0.0, elapsed * 1e-6);
+}
@@ -1,329 +1,2285 @@
 #include <Arduino.h>
-#include <SPIFFS.h>
+#include <esp_timer.h>
+#include <driver/adc.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "sample_ring.h"
+#include "log_format.h"
+#include "adc_capture.h"
+#include "log_storage.h"
+#include "run_store.h"
+#include "dump_format.h"
+#include "crc32.h"
+#include "pid_controller.h"
+#include "step_estimator.h"
+#include "code_scaling.h"
+#include "adc_calibration.h"
+#include "station_config.h"
+#include "line_reader.h"
+#include "telemetry.h"
+#include "csv_format.h"
+#include "net_server.h"
+#include "setpoint_profile.h"
+#include "stage_stats.h"
+#include "trigger_detector.h"
+#include "low_power.h"
+#include "run_stats.h"
+#include "record_query.h"
+#include "build_profile.h"
+#include "boot_state.h"
 
 // ==================== CONFIGURATION ====================
-// Sampling rate in milliseconds
-const unsigned long SAMPLING_INTERVAL_MS = 500;
+// Values marked "default" can be changed at runtime with `set` and are kept
+// in NVS (see station_config.h); `defaults` brings these back. Buffer and
+// queue sizes come from the build profile (build_profile.h).
+
+// Serial console speed (matches monitor_speed in platformio.ini)
+const unsigned long SERIAL_BAUD_RATE = 115200;
+const unsigned long SERIAL_WAIT_MS = 200;  // Boot never waits longer for the console
+
+// Fast boot (boot_state.h): output and logging state go to NVS when they
+// change, checked after every command and at least this often
+const unsigned long BOOT_STATE_SAVE_MS = 5000;
+
+// Console: lines ("set rate 10") or bare keys ("g"). With `set keys 1` one
+// of SINGLE_KEYS sent alone without a line ending runs once no further
+// input arrives for this long. Only keys no word command starts with are
+// listed, so a pause after the first letter of a line never runs a key;
+// g, s, p, c and the newer keys always need Enter.
+const size_t COMMAND_LINE_LENGTH = 96;
+const unsigned long SINGLE_KEY_IDLE_MS = 500;
+const char SINGLE_KEYS[] = "rRiIvVhH?+-";
+const uint8_t DEFAULT_SINGLE_KEYS = 1;
+const size_t MAX_COMMAND_WORDS = 17;  // `set` plus eight name/value pairs
+
+// Default sampling rate in milliseconds (driven by a hardware timer, not loop() polling)
+const unsigned long DEFAULT_SAMPLING_INTERVAL_MS = 500;
 
 // ADC input pin (sensor voltage from station)
 const int ADC_PIN = 34;  // Analog signal input from sensor
 
+// Oversampling: each sample averages 2^shift back-to-back ADC reads (boxcar + decimate)
+const uint8_t DEFAULT_OVERSAMPLE_SHIFT = 4;  // 16 reads per sample
+const uint8_t MAX_OVERSAMPLE_SHIFT = 6;      // 64 reads per sample
+
+// Live binary telemetry (`stream N`): default decimation, 0 = text progress only
+const uint16_t DEFAULT_STREAM_DECIMATION = 0;
+
+// New runs are stored delta-coded (about 1 byte per sample instead of 7); `set compress 0` for raw
+const uint8_t DEFAULT_LOG_COMPRESSION = 1;
+
+// Power-loss window: buffered log data is committed to flash at least this
+// often (rewrites the open compressed block in place, so shorter costs
+// flash writes but no space)
+const uint32_t DEFAULT_COMMIT_INTERVAL_MS = 2000;
+
+// High-rate capture ('f'): ADC continuous/DMA conversion rate before oversampling
+const uint32_t CAPTURE_SAMPLE_RATE_HZ = 20000;  // Lowest rate the ESP32 DMA path supports
+const size_t CAPTURE_POOL_BLOCKS = PROFILE_CAPTURE_POOL_BLOCKS;  // Blocks in flight between capture and storage
+const uint32_t CAPTURE_READ_TIMEOUT_MS = 100;
+
 // DAC output pin (setpoint to TRIAC DRIVE via 0-3.3V to 4-20mA module)
 const int DAC_PIN = 25;  // DAC output (GPIO 25 or 26)
 
+// Auxiliary channels (thermocouple amplifiers, ...) logged next to the
+// sensor in timer runs ('g'), each every `set auxN <ticks>` samples.
+// ADC1 pins only: ADC2 cannot be read while Wi-Fi is on.
+const int AUX_ADC_PINS[MAX_AUX_CHANNELS] = { 35, 32, 33, 39 };
+const uint16_t DEFAULT_AUX_DECIMATION = 0;       // Off until configured
+const size_t CHANNEL_POOL_BLOCKS = PROFILE_CHANNEL_POOL_BLOCKS;  // Channel blocks in flight to storage
+const int AUX_DAC_PIN = 26;                      // Second actuator (`set out2 <V>`)
+const float DEFAULT_AUX_DAC_VOLTAGE = 0.0;
+
+// Trigger mode (`trigger arm`): sampling runs continuously into RAM and
+// only windows around events are logged. History capacity bounds `pre`.
+const size_t PRETRIGGER_CAPACITY = PROFILE_PRETRIGGER_CAPACITY;  // Samples; standard profile: 20 s at 10 ms
+const uint32_t DEFAULT_PRE_TRIGGER_MS = 5000;
+const uint32_t DEFAULT_POST_TRIGGER_MS = 30000;
+const float DEFAULT_TRIGGER_SLOPE_MV_PER_S = 0.0;  // Plant dependent, off by default
+const uint8_t DEFAULT_TRIGGER_ON_SETPOINT = 1;
+
+// Light sleep between timer samples (`set sleep 1`) for long, slow soaks
+const uint8_t DEFAULT_LOW_POWER = 0;
+
 // Setpoint configuration
 // Your module converts: 0V → 4mA, 3.3V → 20mA
 // Assuming station: 4mA → 0%, 20mA → 100% of temperature range
-const float SETPOINT_VOLTAGE = 1.5;  // Setpoint in volts (0 - 3.3V)
-                                      // Adjust this to set your desired temperature
+const float DEFAULT_BASE_VOLTAGE = 0.0;  // Setpoint before the step and after reset
+const float DEFAULT_STEP_VOLTAGE = 1.5;  // Setpoint in volts (0 - 3.3V)
+                                         // Adjust this to set your desired temperature
+
+// Closed-loop control ('l'): PID on the sensor reading, output to the DAC
+// Gains are in volts-per-volt so they survive ADC/DAC width changes
+const unsigned long CONTROL_PERIOD_MS = 10;
+const float DEFAULT_PID_KP = 2.0;    // V/V
+const float DEFAULT_PID_KI = 0.5;    // 1/s
+const float DEFAULT_PID_KD = 0.0;    // s
+const uint8_t CONTROL_OVERSAMPLE_SHIFT = 2;  // 4 reads keep one update well under 1 ms
 
 // Timing
-const unsigned long INITIAL_WAIT_MS = 3000;  // Wait before step (to capture baseline)
+const unsigned long DEFAULT_INITIAL_WAIT_MS = 3000;  // Wait before step (to capture baseline)
 
-// Data file path
-const char* DATA_FILE = "/data.csv";
+// Each test is stored as a run of fixed-size segment files (see run_store.h);
+// old runs are evicted oldest-first when the partition fills
 
-// Maximum file size in bytes
-const size_t MAX_FILE_SIZE = 1000000;
+// RAM sample buffer (samples are written to flash in blocks)
+const size_t SAMPLE_BUFFER_SIZE = PROFILE_SAMPLE_BUFFER_SIZE;  // Ring capacity in samples
+const size_t FLUSH_THRESHOLD = SAMPLE_BUFFER_SIZE / 4;         // Flush to file once this many samples are buffered
+const size_t FLUSH_BLOCK_SIZE = 1024;     // Bytes packed per file write
+const size_t EXPORT_RECORDS = 256;        // Records read per block when exporting
+
+// Dumps ('p' CSV and 'b' binary) move data in chunks of this size
+const size_t DUMP_CHUNK_SIZE = PROFILE_DUMP_CHUNK_SIZE;
+
+// Binary dump ('b') switches the UART to this speed for the transfer
+const unsigned long DUMP_BAUD_RATE = 921600;
+
+// Acquisition -> storage sample queue capacity
+// Sized to ride out long flash operations without dropping samples
+const size_t ACQUISITION_QUEUE_SIZE = PROFILE_ACQUISITION_QUEUE_SIZE;
+
+// Storage -> loop() samples for the step fit; skipped while loop() is behind
+const size_t IDENTIFY_QUEUE_SIZE = PROFILE_IDENTIFY_QUEUE_SIZE;
+
+// Task layout: acquisition on core 1 (with loop()), storage/telemetry on core 0
+const BaseType_t ACQUISITION_CORE = 1;
+const BaseType_t STORAGE_CORE = 0;
+const UBaseType_t ACQUISITION_TASK_PRIORITY = configMAX_PRIORITIES - 2;
+const UBaseType_t STORAGE_TASK_PRIORITY = 2;
+const UBaseType_t CONTROL_TASK_PRIORITY = configMAX_PRIORITIES - 1;  // Preempts acquisition
+const uint32_t TASK_STACK_SIZE = 4096;
+const unsigned long STORAGE_IDLE_MS = 100;  // Storage task wakes at least this often
 
 // ==================== GLOBAL VARIABLES ====================
-unsigned long lastSampleTime = 0;
-unsigned long stepStartTime = 0;
+// Shared by the exports ('p', 'b', `query`, `channels csv`); they run one
+// at a time from loop() under storageMutex
+LogRecord exportRecords[EXPORT_RECORDS];
+alignas(4) uint8_t exportChunk[DUMP_CHUNK_SIZE];
+
 unsigned long sampleCount = 0;
-bool loggingEnabled = false;  // Start disabled, wait for step command
-bool stepApplied = false;
-float currentSetpoint = 0.0;  // Current DAC output voltage
+volatile bool loggingEnabled = false;  // Start disabled, wait for step command
+volatile bool stepApplied = false;
+bool stepAnnounced = false;
+volatile float currentSetpoint = 0.0;  // Current DAC output voltage
+volatile uint8_t currentDacCode = 0;   // Code last written to the DAC
+volatile uint8_t oversampleShift = DEFAULT_OVERSAMPLE_SHIFT;
+adc1_channel_t adcChannel;             // ADC1 channel behind ADC_PIN
+adc1_channel_t auxAdcChannels[MAX_AUX_CHANNELS];  // Behind AUX_ADC_PINS
+volatile uint8_t auxDacCode = 0;       // Code last written to AUX_DAC_PIN
+
+// Raw codes only; volts are computed at the display/export boundary
+struct Sample {
+  uint32_t timestamp;
+  uint16_t adcRaw;
+  uint8_t dacCode;
+};
+
+SampleRing<Sample, SAMPLE_BUFFER_SIZE> sampleBuffer;
+
+// Acquisition (acquisition task produces, storage task consumes)
+esp_timer_handle_t sampleTimer = nullptr;
+TaskHandle_t acquisitionTaskHandle = nullptr;
+TaskHandle_t storageTaskHandle = nullptr;
+SemaphoreHandle_t storageMutex = nullptr;  // Serializes file access between loop() and storage task
+SampleRing<Sample, ACQUISITION_QUEUE_SIZE> acquisitionQueue;
+volatile uint32_t sampleTick = 0;        // Timer periods since logging started
+volatile uint32_t droppedSamples = 0;    // Samples lost because the queue was full
+volatile uint16_t latestAdcRaw = 0;      // Most recent sensor code from either sampling path
+volatile uint32_t timerFireUs = 0;       // esp_timer time of the latest sample timer callback
+bool bootResume = false;                 // Sampling restarted by setup(); the storage task reopens the run
+uint32_t resumeTickOffset = 0;           // Ticks the run held before this boot, added to queued timestamps
+bool bootClockKnown = false;             // Run clock survived the reset: the run's time at the boot is known
+uint16_t bootClockRun = 0;
+uint32_t bootRunTimeMs = 0;              // Run time when setup() restarted sampling
+
+// High-rate capture (capture task fills blocks, storage task writes them)
+TaskHandle_t captureTaskHandle = nullptr;
+CaptureBlock capturePool[CAPTURE_POOL_BLOCKS];
+SampleRing<CaptureBlock*, CAPTURE_POOL_BLOCKS> freeCaptureBlocks;    // storage -> capture
+SampleRing<CaptureBlock*, CAPTURE_POOL_BLOCKS> filledCaptureBlocks;  // capture -> storage
+volatile bool captureActive = false;
+volatile bool captureTaskIdle = true;
+bool captureMode = false;        // Last run used high-rate capture ('s' resumes it)
+uint32_t captureIndex = 0;       // Decimated samples captured since 'f'
+uint8_t captureShift = 0;        // Oversampling shift fixed at capture start
+uint32_t captureIntervalUs = 0;  // Time between decimated capture samples
+uint32_t captureRunBase = 0;     // captureIndex at t=0 of the run being logged
+
+// Auxiliary channels (acquisition task fills blocks, storage task writes them)
+alignas(4) uint8_t channelPool[CHANNEL_POOL_BLOCKS][CHANNEL_BLOCK_SIZE];
+SampleRing<uint8_t*, CHANNEL_POOL_BLOCKS> freeChannelBlocks;    // storage -> acquisition
+SampleRing<uint8_t*, CHANNEL_POOL_BLOCKS> filledChannelBlocks;  // acquisition -> storage
+ChannelBlockBuilder channelBuilder;          // Configured only while a run records channels
+uint8_t channelAux[MAX_AUX_CHANNELS];        // Block channel -> index into AUX_ADC_PINS
+volatile uint32_t droppedChannelTicks = 0;   // Ticks lost because no channel block was free
+volatile bool channelFlushPending = false;   // stopSampling() waits for the acquisition task to submit the open block
+
+// Trigger mode (storage task evaluates every sample on its way to the log)
+bool triggerMode = false;
+TriggerDetector triggerDetector;
+SampleRing<Sample, PRETRIGGER_CAPACITY> preTriggerBuffer;
+size_t preTriggerSamples = 0;     // History kept, from `pre`
+uint32_t postTriggerSamples = 0;  // Window after the last event, from `post`
+uint32_t postRemaining = 0;       // Samples left in the open window, 0 = waiting for an event
+bool triggerForced = false;       // `trigger now`
+uint32_t eventCount = 0;
+uint32_t eventSamplesSeen = 0;    // Since arming
+uint32_t eventSamplesLogged = 0;
+
+// Closed-loop control (control task owns the DAC while closedLoop is set)
+TaskHandle_t controlTaskHandle = nullptr;
+PidController pid;
+volatile bool closedLoop = false;
+volatile uint16_t controlTarget = 0;     // Calibrated sensor value [0.1 mV] the loop regulates to
+volatile bool controlRestart = false;    // Re-apply gains and start bumplessly on next period
+
+// Console input, assembled without blocking
+LineReader<COMMAND_LINE_LENGTH> consoleLine;
+unsigned long lastInputMs = 0;
+
+// Online FOPDT fit of the current run. The storage task only queues raw
+// codes (integer work); loop() runs the double-precision fit and answers 'e'.
+struct IdentifySample {
+  uint32_t timestamp;
+  uint16_t adcRaw;
+  uint8_t dacCode;
+  uint8_t run;          // identifyRun when queued; a new value restarts the fit
+  bool microseconds;    // Capture run timestamps
+};
+
+SampleRing<IdentifySample, IDENTIFY_QUEUE_SIZE> identifyQueue;  // Producers hold storageMutex
+volatile uint8_t identifyRun = 0;        // Bumped by beginRun()
+volatile uint32_t identifySkipped = 0;   // Samples not fitted because the queue was full
+StepEstimator stepEstimator;             // loop() only
+uint8_t fittedRun = 0;                   // identifyRun of the samples in stepEstimator
+
+// Streaming statistics of the logged samples (fed by the storage task, read by `metrics`)
+RunningStats runStats;
+StepResponseTracker stepTracker;
+uint16_t metricsSetpointDmv = 0;
+bool metricsSetpointKnown = false;
+
+// Setpoint profile (`profile` command); empty = the classic single step.
+// Compiled per run into `schedule`, replayed by the sampling task.
+SetpointProfile profile;
+ProfileEntry schedule[PROFILE_MAX_ENTRIES];
+size_t scheduleLength = 0;
+volatile size_t schedulePosition = 0;  // Next row to apply
 
 // ==================== FUNCTION DECLARATIONS ====================
-void initSPIFFS();
-void logData(unsigned long timestamp, float setpoint, float sensorVoltage);
+void initStorage();
+void logData(const Sample& sample);
+void trackSample(uint32_t timestamp, uint16_t adcRaw, uint8_t dacCode);
+void flushSamples();
 float adcToVoltage(int adcValue);
+float dacCodeToVoltage(uint8_t dacCode);
 void setSetpointVoltage(float voltage);
+uint8_t voltageToDacCode(float voltage);
+void writeDacCode(uint8_t dacCode);
+void applySetpoint(float voltage);
+void applySetpointDmv(uint16_t dmv);
+void applySchedule(uint32_t tick);
+bool buildSchedule(uint32_t samplingIntervalUs);
+void setClosedLoop(bool enabled);
+void applyConfig();
+bool testInProgress();
+void controlTask(void* arg);
 void applyStep();
 void printFileContents();
+void queryCommand(char** words, size_t count);
+void dumpFileBinary();
 void clearDataFile();
+bool beginRun(uint32_t samplingIntervalUs, uint16_t flags);
 void printFileInfo();
 void printHelp();
+void printStepFit();
+void printMetrics();
+void summaryCommand(char** words, size_t count);
+void handleCommandLine(char* line);
+void handleKey(char cmd);
+void identifySample(const LogRecord& record, bool microseconds);
+void drainIdentifyQueue();
+void handleWordCommand(char** words, size_t count);
+void setParameters(const char* const* names, const char* const* values, size_t count);
+void stepCommand(char** words, size_t count);
+void calibrationCommand(char** words, size_t count);
+void profileCommand(char** words, size_t count);
+bool loadProfile(const char* path);
+bool saveProfile(const char* path);
+void printProfile();
+void printCalibration();
+void onSampleTimer(void* arg);
+void acquisitionTask(void* arg);
+void storageTask(void* arg);
+void acquireSample();
+uint16_t readSensorRaw();
+uint16_t readAdcAveraged(uint8_t shift);
+uint16_t readChannelAveraged(adc1_channel_t channel, uint8_t shift);
+void scanAuxChannels(uint32_t tick);
+void submitChannelBlock();
+void drainChannelBlocks();
+bool setupChannels(const ChannelFileHeader& header);
+void resumeChannels();
+void writeAuxDacCode(uint8_t dacCode);
+void captureTask(void* arg);
+void startCapture();
+void stopCapture();
+void drainCaptureBlocks();
+void logCaptureBlock(const CaptureBlock& block);
+void startSampling();
+void stopSampling();
+void drainAcquisitionQueue();
+void eventSample(const Sample& sample);
+bool writeRecords(const LogRecord* records, size_t count);
+bool rollCaptureRun(uint32_t firstIndex);
+void statsCommand(char** words, size_t count);
+void channelsCommand(char** words, size_t count);
+void printChannelContents();
+void triggerCommand(char** words, size_t count);
+void sleepUntilNextSample();
+bool restoreBootState();
+void finishBoot();
+void noteRunClock();
+bool runContinues(const RunInfo& run, uint32_t samplingIntervalUs, uint16_t kindFlags, uint64_t nextTimestamp,
+                  uint32_t& lastTimestamp);
+void noteBootState(bool now);
 
 // ==================== SETUP ====================
 void setup() {
-  Serial.begin(115200);
-  while (!Serial) { delay(10); }
+  Serial.setTxBufferSize(TELEMETRY_TX_BUFFER_SIZE);  // Lets telemetry queue packets without blocking
+  Serial.begin(SERIAL_BAUD_RATE);
+  unsigned long serialWaitStart = millis();
+  while (!Serial && millis() - serialWaitStart < SERIAL_WAIT_MS) { delay(10); }
   
   Serial.println("\n========================================");
   Serial.println("   ESP32 Temperature Station Logger");
   Serial.println("   With Setpoint Control");
   Serial.println("========================================");
+  beginStageStats();
+  
+  // The file system is mounted by the storage task (finishBoot()), off
+  // the path to a driven output and running sampler
+  
+  // Runtime parameters: compile-time defaults overlaid with NVS
+  StationConfig defaults = { DEFAULT_SAMPLING_INTERVAL_MS, DEFAULT_INITIAL_WAIT_MS,
+                             DEFAULT_BASE_VOLTAGE, DEFAULT_STEP_VOLTAGE,
+                             DEFAULT_PID_KP, DEFAULT_PID_KI, DEFAULT_PID_KD,
+                             DEFAULT_OVERSAMPLE_SHIFT, DEFAULT_STREAM_DECIMATION,
+                             DEFAULT_LOG_COMPRESSION, DEFAULT_COMMIT_INTERVAL_MS,
+                             { DEFAULT_AUX_DECIMATION, DEFAULT_AUX_DECIMATION,
+                               DEFAULT_AUX_DECIMATION, DEFAULT_AUX_DECIMATION },
+                             DEFAULT_AUX_DAC_VOLTAGE, DEFAULT_PRE_TRIGGER_MS, DEFAULT_POST_TRIGGER_MS,
+                             DEFAULT_TRIGGER_SLOPE_MV_PER_S, DEFAULT_TRIGGER_ON_SETPOINT,
+                             DEFAULT_LOW_POWER, DEFAULT_SINGLE_KEYS };
+  beginConfig(defaults);
+  applyConfig();
   
-  // Initialize SPIFFS
-  initSPIFFS();
+  // Setpoint output as it was before a reset (base setpoint otherwise)
+  bool resumeLogging = restoreBootState();
   
   // Configure ADC (input from sensor)
   analogReadResolution(12);  // 12-bit resolution (0-4095)
   analogSetAttenuation(ADC_11db);  // Full range: 0-3.3V
   pinMode(ADC_PIN, INPUT);
+  analogRead(ADC_PIN);  // Attaches the pin and applies attenuation for the raw reads below
+  adcChannel = (adc1_channel_t)digitalPinToAnalogChannel(ADC_PIN);
+  for (size_t i = 0; i < MAX_AUX_CHANNELS; i++) {
+    pinMode(AUX_ADC_PINS[i], INPUT);
+    analogRead(AUX_ADC_PINS[i]);
+    auxAdcChannels[i] = (adc1_channel_t)digitalPinToAnalogChannel(AUX_ADC_PINS[i]);
+  }
+  beginAdcCalibration();
+  
+  // Acquisition and storage tasks, joined by acquisitionQueue
+  storageMutex = xSemaphoreCreateMutex();
+  xTaskCreatePinnedToCore(acquisitionTask, "acquisition", TASK_STACK_SIZE, nullptr,
+                          ACQUISITION_TASK_PRIORITY, &acquisitionTaskHandle, ACQUISITION_CORE);
+  xTaskCreatePinnedToCore(storageTask, "storage", TASK_STACK_SIZE, nullptr,
+                          STORAGE_TASK_PRIORITY, &storageTaskHandle, STORAGE_CORE);
+  for (size_t i = 0; i < CAPTURE_POOL_BLOCKS; i++) {
+    freeCaptureBlocks.push(&capturePool[i]);
+  }
+  xTaskCreatePinnedToCore(captureTask, "capture", TASK_STACK_SIZE, nullptr,
+                          ACQUISITION_TASK_PRIORITY, &captureTaskHandle, ACQUISITION_CORE);
+  xTaskCreatePinnedToCore(controlTask, "control", TASK_STACK_SIZE, nullptr,
+                          CONTROL_TASK_PRIORITY, &controlTaskHandle, ACQUISITION_CORE);
+  
+  // Optional Wi-Fi data server (only if credentials were saved with `wifi`)
+  beginNetServer(storageMutex);
+  
+  // Periodic sampling timer (started by 'g')
+  esp_timer_create_args_t timerArgs = {};
+  timerArgs.callback = onSampleTimer;
+  timerArgs.dispatch_method = ESP_TIMER_TASK;
+  timerArgs.name = "sample";
+  if (esp_timer_create(&timerArgs, &sampleTimer) != ESP_OK) {
+    Serial.println("ERROR: Could not create sampling timer!");
+  }
   
-  // Initialize DAC output to 0V (4mA = minimum setpoint)
-  setSetpointVoltage(0.0);
+  beginLowPower();
+  
+  // Sampling into RAM right away; storage catches up once mounted
+  if (resumeLogging) {
+    bootResume = true;
+    captureMode = false;
+    bootClockKnown = readRunClock(bootClockRun, bootRunTimeMs);
+    startSampling();
+  }
   
   Serial.printf("\nHardware Configuration:\n");
   Serial.printf("  Sensor Input:    GPIO %d (ADC)\n", ADC_PIN);
   Serial.printf("  Setpoint Output: GPIO %d (DAC)\n", DAC_PIN);
-  Serial.printf("  Sampling Rate:   %lu ms\n", SAMPLING_INTERVAL_MS);
-  Serial.printf("  Step Setpoint:   %.2f V\n", SETPOINT_VOLTAGE);
+  Serial.printf("  Aux Inputs:      GPIO %d/%d/%d/%d (ADC), output GPIO %d (DAC)\n",
+                AUX_ADC_PINS[0], AUX_ADC_PINS[1], AUX_ADC_PINS[2], AUX_ADC_PINS[3], AUX_DAC_PIN);
+  Serial.printf("  Sampling Rate:   %lu ms\n", (unsigned long)config.samplingIntervalMs);
+  Serial.printf("  Build Profile:   %s (queue %u, buffer %u samples, pre-trigger %u)\n", BUILD_PROFILE_NAME,
+                (unsigned)ACQUISITION_QUEUE_SIZE, (unsigned)SAMPLE_BUFFER_SIZE, (unsigned)PRETRIGGER_CAPACITY);
+  Serial.printf("  Oversampling:    %u reads/sample\n", 1u << oversampleShift);
+  Serial.printf("  ADC Calibration: %s + %u user points\n", calibrationSource(), calibrationPointCount());
+  Serial.printf("  Step Setpoint:   %.2f V -> %.2f V after %lu ms\n",
+                config.baseVoltage, config.stepVoltage, (unsigned long)config.initialWaitMs);
   
   printHelp();
   
-  // Print file info at startup
+  if (resumeLogging) {
+    Serial.printf("\n>>> FAST BOOT: setpoint %.2fV restored, sampling resumed <<<\n\n", currentSetpoint);
+  } else {
+    Serial.printf("\n>>> Setpoint at %.2fV. Press 'g' to start step response test <<<\n\n", currentSetpoint);
+  }
+}
+
+// Puts the setpoint output (and closed loop) back as saved in NVS, or at
+// the base setpoint. True if a timer run was logging past its step and
+// should resume; a test reset during its baseline is not resumed, as the
+// step schedule lives in RAM only and would never fire.
+bool restoreBootState() {
+  BootState state;
+  if (!loadBootState(state)) {
+    setSetpointVoltage(config.baseVoltage);  // 0V = 4mA = minimum setpoint
+    return false;
+  }
+  writeDacCode(state.dacCode);
+  currentSetpoint = dacCodeToVoltage(state.dacCode);
+  if (state.flags & BOOT_CLOSED_LOOP) {
+    controlTarget = state.controlTarget;
+    currentSetpoint = state.controlTarget * (1.0f / DMV_PER_VOLT);
+    controlRestart = true;
+    closedLoop = true;
+  }
+  stepApplied = state.flags & BOOT_STEP_APPLIED;
+  stepAnnounced = stepApplied;  // Announced before the reset
+  return (state.flags & BOOT_LOGGING) && stepApplied;
+}
+
+// Storage side of the boot, run by the storage task before its first pass
+// (caller holds storageMutex). Samples queued since setup() are logged
+// into the run that was open before the reset, stamped with the run time
+// the run clock gives, so the time the station was down stays in the run.
+// Without the run clock (power cut) the gap is unknown: a new run starts.
+void finishBoot() {
+  initStorage();
+  if (bootResume) {
+    bootResume = false;
+    const RunInfo* run = latestRun();
+    uint32_t offsetTicks = (bootRunTimeMs + config.samplingIntervalMs - 1) / config.samplingIntervalMs;
+    uint32_t lastTimestamp = 0;
+    bool continues = run && bootClockKnown && bootClockRun == run->runId &&
+                     runContinues(*run, config.samplingIntervalMs * 1000, 0,
+                                  (uint64_t)offsetTicks * config.samplingIntervalMs, lastTimestamp);
+    if (continues && resumeRun()) {
+      resumeTickOffset = offsetTicks;
+      Serial.printf(">>> FAST BOOT: run %u continues at t=%lu ms (%lu ms not sampled) <<<\n", run->runId,
+                    (unsigned long)(resumeTickOffset * config.samplingIntervalMs),
+                    (unsigned long)(resumeTickOffset * config.samplingIntervalMs - lastTimestamp -
+                                    config.samplingIntervalMs));
+      noteRunClock();
+    } else if (startRun(config.samplingIntervalMs * 1000, config.compressLog ? LOG_FLAG_COMPRESSED | LOG_FLAG_BLOCK_CRC : 0,
+                        currentDacCode)) {
+      Serial.printf(">>> FAST BOOT: logging into new run %u%s <<<\n", latestRun()->runId,
+                    bootClockKnown ? "" : " (time since the reset unknown)");
+      noteRunClock();
+    } else {
+      loggingEnabled = false;
+      esp_timer_stop(sampleTimer);
+      acquisitionQueue.clear();
+      Serial.println("ERROR: Fast boot could not open a run, logging stopped");
+    }
+  }
   printFileInfo();
-  
-  Serial.println("\n>>> Setpoint at 0V. Press 'g' to start step response test <<<\n");
+}
+
+// True if `run` can take records of this kind (`kindFlags`: TIMESTAMP_US,
+// EVENTS or neither) stamped `nextTimestamp` onward: same kind, same
+// interval, and past its last record, which is returned in `lastTimestamp`
+bool runContinues(const RunInfo& run, uint32_t samplingIntervalUs, uint16_t kindFlags, uint64_t nextTimestamp,
+                  uint32_t& lastTimestamp) {
+  if ((run.flags & (LOG_FLAG_TIMESTAMP_US | LOG_FLAG_EVENTS)) != kindFlags ||
+      run.samplingIntervalUs != samplingIntervalUs || run.sampleCount == 0) {
+    return false;
+  }
+  LogRecord last;
+  RunReader reader;
+  bool read = reader.open(run) && reader.seekRecord(run.sampleCount - 1) &&
+              reader.read((uint8_t*)&last, sizeof(last)) == sizeof(last);
+  reader.close();
+  if (!read) return false;
+  lastTimestamp = last.timestamp;
+  return nextTimestamp > last.timestamp;
+}
+
+// Saves the state restoreBootState() needs when it has changed. In closed
+// loop only the target is kept: the PID output moves every period.
+void noteBootState(bool now) {
+  static unsigned long lastCheckMs = 0;
+  if (!now && millis() - lastCheckMs < BOOT_STATE_SAVE_MS) return;
+  lastCheckMs = millis();
+  BootState state = {};
+  state.flags = (loggingEnabled && !triggerMode && stepApplied ? BOOT_LOGGING : 0) |
+                (stepApplied ? BOOT_STEP_APPLIED : 0) | (closedLoop ? BOOT_CLOSED_LOOP : 0);
+  state.dacCode = closedLoop ? 0 : currentDacCode;
+  state.controlTarget = closedLoop ? (uint16_t)controlTarget : 0;
+  saveBootState(state);
 }
 
 // ==================== MAIN LOOP ====================
+// Only handles commands; sampling and logging run in their own tasks
 void loop() {
-  // Handle serial commands
-  if (Serial.available()) {
-    char cmd = Serial.read();
-    switch (cmd) {
-      case 'g':  // GO - Start step response test
-      case 'G':
-        if (!stepApplied) {
-          clearDataFile();  // Clear old data
-          loggingEnabled = true;
-          stepStartTime = millis();
-          Serial.println("\n>>> LOGGING STARTED - Recording baseline... <<<");
-          Serial.printf(">>> Step will be applied in %lu ms <<<\n\n", INITIAL_WAIT_MS);
-        } else {
-          Serial.println("Step already applied. Press 'r' to reset first.");
-        }
-        break;
-        
-      case 'r':  // RESET - Reset to initial state
-      case 'R':
-        setSetpointVoltage(0.0);
-        stepApplied = false;
-        loggingEnabled = false;
-        sampleCount = 0;
-        Serial.println("\n>>> RESET: Setpoint back to 0V. Press 'g' to start new test <<<\n");
-        break;
-        
-      case 'p':  // PRINT file contents
-      case 'P':
-        loggingEnabled = false;  // Pause logging while printing
-        printFileContents();
-        break;
-        
-      case 'c':  // CLEAR data file
-      case 'C':
-        clearDataFile();
-        break;
-        
-      case 'i':  // INFO - file info
-      case 'I':
-        printFileInfo();
-        break;
-        
-      case 's':  // STOP/START logging
-      case 'S':
-        loggingEnabled = !loggingEnabled;
-        Serial.printf("Logging %s\n", loggingEnabled ? "ENABLED" : "DISABLED");
-        break;
-        
-      case 'v':  // Show current VALUES
-      case 'V':
-        Serial.printf("\nCurrent Setpoint: %.2f V\n", currentSetpoint);
-        Serial.printf("Current Sensor:   %.3f V\n", adcToVoltage(analogRead(ADC_PIN)));
-        Serial.printf("Step Applied:     %s\n", stepApplied ? "YES" : "NO");
-        Serial.printf("Logging:          %s\n", loggingEnabled ? "ON" : "OFF");
-        Serial.printf("Samples:          %lu\n\n", sampleCount);
-        break;
-        
-      case 'h':  // HELP
-      case 'H':
-      case '?':
-        printHelp();
-        break;
-        
-      case '+':  // Manually increase setpoint
-        currentSetpoint += 0.1;
-        if (currentSetpoint > 3.3) currentSetpoint = 3.3;
-        setSetpointVoltage(currentSetpoint);
-        Serial.printf("Setpoint: %.2f V\n", currentSetpoint);
-        break;
-        
-      case '-':  // Manually decrease setpoint
-        currentSetpoint -= 0.1;
-        if (currentSetpoint < 0) currentSetpoint = 0;
-        setSetpointVoltage(currentSetpoint);
-        Serial.printf("Setpoint: %.2f V\n", currentSetpoint);
-        break;
+  drainIdentifyQueue();
+  
+  // The step itself is applied by the acquisition task; report it here
+  if (stepApplied && !stepAnnounced) {
+    stepAnnounced = true;
+    applyStep();
+  }
+  
+  // Assemble console input without blocking; the sampler never waits on it
+  while (Serial.available()) {
+    lastInputMs = millis();
+    if (consoleLine.feed(Serial.read())) {
+      handleCommandLine(consoleLine.line());
+      consoleLine.clear();
     }
   }
   
-  // Apply step after initial wait period
-  if (loggingEnabled && !stepApplied && (millis() - stepStartTime >= INITIAL_WAIT_MS)) {
-    applyStep();
+  // A single key typed without a line ending: only one of SINGLE_KEYS,
+  // and only if it is all that was typed
+  if (config.singleKeys && consoleLine.pending() == 1 && strchr(SINGLE_KEYS, consoleLine.first()) &&
+      millis() - lastInputMs >= SINGLE_KEY_IDLE_MS) {
+    char key[2] = { consoleLine.first(), '\0' };
+    consoleLine.clear();
+    handleCommandLine(key);
   }
   
-  // Sample at configured interval
-  unsigned long currentTime = millis();
-  if (loggingEnabled && (currentTime - lastSampleTime >= SAMPLING_INTERVAL_MS)) {
-    lastSampleTime = currentTime;
-    
-    // Calculate timestamp relative to step start
-    unsigned long relativeTime = currentTime - stepStartTime;
-    
-    // Read sensor voltage
-    int rawValue = analogRead(ADC_PIN);
-    float sensorVoltage = adcToVoltage(rawValue);
-    
-    // Log to file (timestamp, setpoint, sensor reading)
-    logData(relativeTime, currentSetpoint, sensorVoltage);
-    
-    // Print to serial (every 10 samples)
-    sampleCount++;
-    if (sampleCount % 10 == 0) {
-      Serial.printf("[%lu] t=%lu ms, Setpoint=%.2fV, Sensor=%.3fV\n", 
-                    sampleCount, relativeTime, currentSetpoint, sensorVoltage);
+  pollNetServer();
+  noteBootState(false);
+  if (config.lowPower) {
+    sleepUntilNextSample();
+  } else {
+    delay(1);
+  }
+}
+
+// Low-power mode: sleeps through the gap to the next timer sample once
+// every task is idle. Closed loop, DMA capture, Wi-Fi and a half-typed
+// command keep the chip awake.
+void sleepUntilNextSample() {
+  bool quiet = loggingEnabled && !captureActive && !closedLoop && !netServerActive() &&
+               consoleLine.pending() == 0 && !Serial.available();
+  // Holding the mutex keeps the storage task (and flash) idle while asleep
+  if (!quiet || xSemaphoreTake(storageMutex, 0) != pdTRUE) {
+    delay(1);
+    return;
+  }
+  bool slept = false;
+  if (acquisitionQueue.empty() && filledChannelBlocks.empty()) {
+    Serial.flush();  // Sleep stops the UART mid-character otherwise
+    slept = sleepUntilNextAlarm();
+  }
+  xSemaphoreGive(storageMutex);
+  if (!slept) delay(1);
+}
+
+// ==================== COMMANDS ====================
+// Runs one console line: a lone character is a key command, anything else
+// a word command. Holds storageMutex so the storage task stays off the file.
+void handleCommandLine(char* line) {
+  char* words[MAX_COMMAND_WORDS];
+  size_t count = 0;
+  char* save = nullptr;
+  for (char* word = strtok_r(line, " \t", &save); word; word = strtok_r(nullptr, " \t", &save)) {
+    if (count == MAX_COMMAND_WORDS) {
+      Serial.println("ERROR: Too many words in command");
+      return;
     }
+    words[count++] = word;
+  }
+  if (count == 0) return;
+  
+  xSemaphoreTake(storageMutex, portMAX_DELAY);
+  uint32_t start = stageStart();
+  if (count == 1 && words[0][1] == '\0') {
+    handleKey(words[0][0]);
+  } else {
+    handleWordCommand(words, count);
+  }
+  stageEnd(STAGE_COMMAND, start);
+  xSemaphoreGive(storageMutex);
+  noteBootState(true);
+}
+
+// Single-character commands (caller holds storageMutex)
+void handleKey(char cmd) {
+  switch (cmd) {
+    case 'g':  // GO - Start step response test
+    case 'G':
+      if (captureActive) {
+        Serial.println("High-rate capture running. Press 'r' to reset first.");
+      } else if (!stepApplied && !loggingEnabled && beginRun(config.samplingIntervalMs * 1000, 0)) {
+        triggerMode = false;
+        acquisitionQueue.clear();
+        sampleTick = 0;
+        droppedSamples = 0;
+        stepAnnounced = false;
+        captureMode = false;
+        startSampling();
+        Serial.println("\n>>> LOGGING STARTED - Recording baseline... <<<");
+        Serial.printf(">>> Step will be applied in %lu ms <<<\n\n", (unsigned long)config.initialWaitMs);
+      } else if (stepApplied || loggingEnabled) {
+        Serial.println("Step already applied. Press 'r' to reset first.");
+      }
+      break;
+      
+    case 'f':  // FAST - Step response test on high-rate DMA capture
+    case 'F':
+      if (stepApplied || loggingEnabled || captureActive) {
+        Serial.println("Test already running or step applied. Press 'r' to reset first.");
+        break;
+      }
+      captureShift = oversampleShift;
+      captureIntervalUs = (1000000UL / CAPTURE_SAMPLE_RATE_HZ) << captureShift;
+      if (beginRun(captureIntervalUs, LOG_FLAG_TIMESTAMP_US)) {
+        triggerMode = false;
+        captureIndex = 0;
+        captureRunBase = 0;
+        droppedSamples = 0;
+        stepAnnounced = false;
+        captureMode = true;
+        startCapture();
+        Serial.printf("\n>>> HIGH-RATE CAPTURE STARTED - %lu us/sample <<<\n", (unsigned long)captureIntervalUs);
+        Serial.printf(">>> Step will be applied in %lu ms <<<\n\n", (unsigned long)config.initialWaitMs);
+      }
+      break;
+      
+    case 'r':  // RESET - Reset to initial state
+    case 'R':
+      stopCapture();
+      stopSampling();
+      flushSamples();
+      triggerMode = false;
+      setClosedLoop(false);
+      setSetpointVoltage(config.baseVoltage);
+      stepApplied = false;
+      sampleCount = 0;
+      Serial.printf("\n>>> RESET: Setpoint back to %.2fV. Press 'g' to start new test <<<\n\n", config.baseVoltage);
+      break;
+      
+    case 'p':  // PRINT file contents
+    case 'P':
+      stopCapture();   // Pause logging while printing
+      stopSampling();
+      flushSamples();
+      printFileContents();
+      break;
+      
+    case 'b':  // BINARY dump of the raw data file (framed, CRC-checked)
+    case 'B':
+      stopCapture();
+      stopSampling();
+      flushSamples();
+      dumpFileBinary();
+      break;
+      
+    case 'c':  // CLEAR all stored runs
+    case 'C':
+      stopCapture();
+      stopSampling();
+      clearDataFile();
+      break;
+      
+    case 'i':  // INFO - file info
+    case 'I':
+      printFileInfo();
+      break;
+      
+    case 's':  // STOP/START logging
+    case 'S':
+      if (captureActive) {
+        stopCapture();
+      } else if (loggingEnabled) {
+        stopSampling();
+      } else {
+        // Append to the latest run if it is of this mode and the time base
+        // continues past its last record; a new run otherwise
+        const RunInfo* run = latestRun();
+        uint32_t intervalUs = captureMode ? captureIntervalUs : config.samplingIntervalMs * 1000;
+        uint16_t kind = captureMode ? LOG_FLAG_TIMESTAMP_US : triggerMode ? LOG_FLAG_EVENTS : 0;
+        uint64_t nextTimestamp = captureMode ? (uint64_t)(captureIndex - captureRunBase) * captureIntervalUs
+                                             : (uint64_t)(sampleTick + resumeTickOffset) * config.samplingIntervalMs;
+        uint32_t lastTimestamp;
+        bool resumed = run && runContinues(*run, intervalUs, kind, nextTimestamp, lastTimestamp) && resumeRun();
+        if (resumed) resumeChannels();
+        if (resumed || beginRun(intervalUs, kind)) {
+          if (captureMode) {
+            startCapture();
+          } else {
+            startSampling();
+          }
+        }
+      }
+      flushSamples();
+      Serial.printf("Logging %s\n", (loggingEnabled || captureActive) ? "ENABLED" : "DISABLED");
+      break;
+      
+    case 'v':  // Show current VALUES
+    case 'V':
+      Serial.printf("\nCurrent Setpoint: %.2f V\n", currentSetpoint);
+      Serial.printf("Control:          %s\n", closedLoop ? "CLOSED LOOP" : "OPEN LOOP");
+      if (closedLoop) {
+        Serial.printf("Control Target:   %.3f V\n", controlTarget * (1.0f / DMV_PER_VOLT));
+        Serial.printf("DAC Output:       %.2f V\n", dacCodeToVoltage(currentDacCode));
+      }
+      // The DMA capture owns ADC1 while it runs; report its latest code instead
+      Serial.printf("Current Sensor:   %.3f V\n",
+                    adcToVoltage(captureActive ? latestAdcRaw : readSensorRaw()));
+      Serial.printf("Step Applied:     %s\n", stepApplied ? "YES" : "NO");
+      if (profile.segmentCount() > 0) {
+        Serial.printf("Profile:          %u/%u changes applied\n", schedulePosition, scheduleLength);
+      }
+      Serial.printf("Logging:          %s\n", loggingEnabled ? "ON" : captureActive ? "ON (high-rate)" : "OFF");
+      Serial.printf("Oversampling:     %u reads/sample\n", 1u << oversampleShift);
+      Serial.printf("Samples:          %lu\n", sampleCount);
+      Serial.printf("Dropped:          %lu\n", (unsigned long)droppedSamples);
+      if (config.streamDecimation > 0) {
+        Serial.printf("Telemetry:        every %u, %lu packets, %lu dropped\n", config.streamDecimation,
+                      (unsigned long)telemetryPacketsSent(), (unsigned long)telemetryPacketsDropped());
+      }
+      Serial.println();
+      break;
+      
+    case 'o':  // Cycle OVERSAMPLING factor (1, 4, 16, 64 reads); same as `set os`
+    case 'O': {
+      uint8_t next = oversampleShift + 2 > MAX_OVERSAMPLE_SHIFT ? 0 : oversampleShift + 2;
+      char shift[2] = { (char)('0' + next), '\0' };
+      const char* name = "os";
+      const char* value = shift;
+      setParameters(&name, &value, 1);
+      Serial.printf("Oversampling: %u reads/sample\n", 1u << oversampleShift);
+      break;
+    }
+      
+    case 'l':  // Toggle closed-LOOP control (holds the current reading)
+    case 'L':
+      setClosedLoop(!closedLoop);
+      if (closedLoop) {
+        Serial.printf("Closed loop ON: target %.3f V (Kp=%.2f Ki=%.2f Kd=%.3f)\n",
+                      controlTarget * (1.0f / DMV_PER_VOLT), config.kp, config.ki, config.kd);
+      } else {
+        Serial.printf("Closed loop OFF: setpoint held at %.2f V\n", currentSetpoint);
+      }
+      break;
+      
+    case 'e':  // ESTIMATE - FOPDT fit of the running/last step test
+    case 'E':
+      printStepFit();
+      break;
+      
+    case 'k':  // Show ADC CALIBRATION points (`cal` adds them)
+    case 'K':
+      printCalibration();
+      break;
+      
+    case 'h':  // HELP
+    case 'H':
+    case '?':
+      printHelp();
+      break;
+      
+    case '+':  // Manually increase setpoint (control target in closed loop)
+      currentSetpoint += 0.1;
+      if (currentSetpoint > 3.3f) currentSetpoint = 3.3f;
+      applySetpoint(currentSetpoint);
+      Serial.printf("%s: %.2f V\n", closedLoop ? "Target" : "Setpoint", currentSetpoint);
+      break;
+      
+    case '-':  // Manually decrease setpoint (control target in closed loop)
+      currentSetpoint -= 0.1;
+      if (currentSetpoint < 0) currentSetpoint = 0;
+      applySetpoint(currentSetpoint);
+      Serial.printf("%s: %.2f V\n", closedLoop ? "Target" : "Setpoint", currentSetpoint);
+      break;
   }
 }
 
 // ==================== FUNCTION DEFINITIONS ====================
 
-void initSPIFFS() {
-  if (!SPIFFS.begin(true)) {
-    Serial.println("ERROR: SPIFFS mount failed!");
+void initStorage() {
+  if (!storageBegin()) {
+    Serial.printf("ERROR: %s mount failed!\n", storageName());
     return;
   }
-  Serial.println("SPIFFS mounted successfully");
+  Serial.printf("%s mounted successfully\n", storageName());
   
-  // Create file with header if it doesn't exist
-  if (!SPIFFS.exists(DATA_FILE)) {
-    File file = SPIFFS.open(DATA_FILE, FILE_WRITE);
-    if (file) {
-      file.println("timestamp_ms,setpoint_v,sensor_v");
-      file.close();
-      Serial.println("Created new data file with header");
-    }
-  }
+  // Loads the run index only; data segments are not opened
+  beginRunStore();
+  Serial.printf("%u runs stored\n", runCount());
 }
 
+// Display boundary only: calibrated table lookup, single-precision scale
 float adcToVoltage(int adcValue) {
-  // ESP32 ADC: 12-bit (0-4095), 3.3V reference
-  return (adcValue / 4095.0) * 3.3;
+  return calibratedDmv(adcValue) * (1.0f / DMV_PER_VOLT);
+}
+
+float dacCodeToVoltage(uint8_t dacCode) {
+  return dacCodeToDmv(dacCode) * (1.0f / DMV_PER_VOLT);
 }
 
 void setSetpointVoltage(float voltage) {
   // Clamp to valid range
   if (voltage < 0) voltage = 0;
-  if (voltage > 3.3) voltage = 3.3;
+  if (voltage > 3.3f) voltage = 3.3f;
   
   currentSetpoint = voltage;
   
   // ESP32 DAC: 8-bit (0-255) for 0-3.3V
-  int dacValue = (int)((voltage / 3.3) * 255);
-  dacWrite(DAC_PIN, dacValue);
+  writeDacCode(voltageToDacCode(voltage));
+}
+
+void writeDacCode(uint8_t dacCode) {
+  currentDacCode = dacCode;
+  dacWrite(DAC_PIN, dacCode);
+}
+
+void writeAuxDacCode(uint8_t dacCode) {
+  auxDacCode = dacCode;
+  dacWrite(AUX_DAC_PIN, dacCode);
+}
+
+uint8_t voltageToDacCode(float voltage) {
+  return dmvToDacCode(voltsToDmv(voltage));
+}
+
+// Open loop: drive the DAC directly. Closed loop: move the control target;
+// currentSetpoint then tracks the target, not the DAC output
+void applySetpoint(float voltage) {
+  if (voltage < 0) voltage = 0;
+  if (voltage > 3.3f) voltage = 3.3f;
+  if (closedLoop) {
+    currentSetpoint = voltage;
+    controlTarget = voltsToDmv(voltage);
+  } else {
+    setSetpointVoltage(voltage);
+  }
+}
+
+// Same from the sampling tasks: integer path, no clamping needed
+void applySetpointDmv(uint16_t dmv) {
+  currentSetpoint = dmv * (1.0f / DMV_PER_VOLT);
+  if (closedLoop) {
+    controlTarget = dmv;
+  } else {
+    writeDacCode(dmvToDacCode(dmv));
+  }
+}
+
+// Applies the schedule rows due by sample `tick`; several due at once
+// (capture blocks) collapse to the latest
+void applySchedule(uint32_t tick) {
+  size_t position = schedulePosition;
+  if (position >= scheduleLength || schedule[position].tick > tick) return;
+  while (position < scheduleLength && schedule[position].tick <= tick) position++;
+  applySetpointDmv(schedule[position - 1].dmv);
+  schedulePosition = position;
+  stepApplied = true;
+}
+
+// Compiles the profile (or the base -> step test) for this sampling period
+bool buildSchedule(uint32_t samplingIntervalUs) {
+  SetpointProfile classic;
+  const SetpointProfile* active = &profile;
+  if (profile.segmentCount() == 0) {
+    classic.add({ PROFILE_HOLD, 0, (uint16_t)voltsToDmv(config.baseVoltage), 0, config.initialWaitMs });
+    classic.add({ PROFILE_HOLD, 0, (uint16_t)voltsToDmv(config.stepVoltage), 0, 0 });
+    active = &classic;
+  }
+  schedulePosition = 0;
+  scheduleLength = 0;
+  size_t length;
+  if (!active->compile(samplingIntervalUs, voltsToDmv(config.baseVoltage), schedule, PROFILE_MAX_ENTRIES, length)) {
+    return false;
+  }
+  scheduleLength = length;
+  return true;
+}
+
+// Enabling holds the present sensor reading as the target so nothing jumps
+void setClosedLoop(bool enabled) {
+  if (enabled == closedLoop) return;
+  if (enabled) {
+    uint16_t measurement = calibratedDmv(captureActive ? latestAdcRaw : readAdcAveraged(CONTROL_OVERSAMPLE_SHIFT));
+    controlTarget = measurement;
+    currentSetpoint = measurement * (1.0f / DMV_PER_VOLT);
+    controlRestart = true;
+    closedLoop = true;
+  } else {
+    closedLoop = false;
+    currentSetpoint = dacCodeToVoltage(currentDacCode);
+  }
+}
+
+// Pushes runtime parameters to the running tasks; gains take effect on the
+// next control period (integrator is re-seeded bumplessly)
+void applyConfig() {
+  oversampleShift = config.oversampleShift;
+  setTelemetryDecimation(config.streamDecimation);
+  writeAuxDacCode(voltageToDacCode(config.auxDacVoltage));
+  PidController check;  // Same scaling as controlTask
+  if (!check.configure(config.kp, config.ki, config.kd, CONTROL_PERIOD_MS * 1000, 0, DAC_MAX_CODE, FULL_SCALE_DMV, DAC_MAX_CODE)) {
+    Serial.println("WARNING: A PID gain is below the controller's resolution and acts as 0");
+  }
+  controlRestart = true;
+}
+
+// Rate, wait and setpoints are fixed from 'g'/'f' until 'r'
+bool testInProgress() {
+  return loggingEnabled || captureActive || stepApplied;
 }
 
 void applyStep() {
+  // DAC has already been switched by acquireSample() at the exact sample boundary
   Serial.println("\n========================================");
-  Serial.println(">>> STEP APPLIED! <<<");
-  Serial.printf(">>> Setpoint changed: 0V → %.2fV <<<\n", SETPOINT_VOLTAGE);
+  if (profile.segmentCount() > 0) {
+    Serial.println(">>> PROFILE RUNNING! <<<");
+    Serial.printf(">>> %u setpoint changes over %.1f s <<<\n", scheduleLength, profile.lengthMs() / 1000.0f);
+  } else {
+    Serial.println(">>> STEP APPLIED! <<<");
+    Serial.printf(">>> Setpoint changed: %.2fV → %.2fV <<<\n", config.baseVoltage, config.stepVoltage);
+  }
   Serial.println("========================================\n");
+}
+
+// Fires every config.samplingIntervalMs; hands the work to the acquisition task
+void onSampleTimer(void* arg) {
+  timerFireUs = (uint32_t)esp_timer_get_time();
+  xTaskNotifyGive(acquisitionTaskHandle);
+}
+
+// Pinned to ACQUISITION_CORE at high priority; never touches Serial or flash
+void acquisitionTask(void* arg) {
+  for (;;) {
+    // One notification per timer period (counts up if we ever fall behind)
+    if (ulTaskNotifyTake(pdFALSE, portMAX_DELAY) > 1 && loggingEnabled) noteMissedDeadline();
+    acquireSample();
+    if (channelFlushPending) {
+      submitChannelBlock();  // Sampling stopped: nothing more goes into the block
+      channelFlushPending = false;
+    }
+  }
+}
+
+// Pinned to STORAGE_CORE; drains samples into the log, prints progress and
+// feeds the live streams (UART telemetry, WebSocket)
+void storageTask(void* arg) {
+  // Mount and index work happen here, while sampling already runs;
+  // commands wait on the mutex until it is done
+  xSemaphoreTake(storageMutex, portMAX_DELAY);
+  finishBoot();
+  xSemaphoreGive(storageMutex);
+  beginHeapWatch();  // Boot done: file system mounted, run reopened
   
-  setSetpointVoltage(SETPOINT_VOLTAGE);
-  stepApplied = true;
+  uint32_t lastCommitMs = millis();
+  for (;;) {
+    bool notified = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STORAGE_IDLE_MS)) > 0;
+    xSemaphoreTake(storageMutex, portMAX_DELAY);
+    uint32_t start = stageStart();
+    drainAcquisitionQueue();
+    drainCaptureBlocks();
+    drainChannelBlocks();
+    if (notified) stageEnd(STAGE_STORAGE_PASS, start);
+    
+    // Bounded data loss on power failure: push buffered samples to flash
+    uint32_t now = millis();
+    if (!runIsOpen() || config.commitIntervalMs == 0) {
+      lastCommitMs = now;
+    } else if (now - lastCommitMs >= config.commitIntervalMs) {
+      flushSamples();
+      if (!commitRun()) Serial.println("ERROR: Log commit failed");
+      lastCommitMs = now;
+    }
+    xSemaphoreGive(storageMutex);
+    flushNetSamples();  // Ages out a partial WebSocket batch even when idle
+  }
 }
 
-void logData(unsigned long timestamp, float setpoint, float sensorVoltage) {
-  // Check file size before writing
-  File file = SPIFFS.open(DATA_FILE, FILE_READ);
-  if (file) {
-    size_t fileSize = file.size();
+void acquireSample() {
+  if (!loggingEnabled) return;  // Late notification after the timer was stopped
+  
+  // Wake-up latency and period jitter against the timer (esp_timer runs on the other core)
+  static uint32_t previousStartUs = 0;
+  static uint32_t previousTick = 0;
+  uint32_t startUs = (uint32_t)esp_timer_get_time();
+  uint32_t firedUs = timerFireUs;
+  uint32_t intervalUs = config.samplingIntervalMs * 1000;
+  uint32_t tick = sampleTick;
+  stageRecordUs(STAGE_SAMPLE_WAKE, startUs - firedUs);
+  if (tick > 0 && tick == previousTick + 1) {
+    uint32_t periodUs = startUs - previousStartUs;
+    stageRecordUs(STAGE_SAMPLE_JITTER, periodUs > intervalUs ? periodUs - intervalUs : intervalUs - periodUs);
+  }
+  previousStartUs = startUs;
+  previousTick = tick;
+  
+  uint32_t relativeTime = tick * config.samplingIntervalMs;
+  
+  // Step or profile changes land exactly on this sample
+  applySchedule(tick);
+  
+  uint32_t readStart = stageStart();
+  Sample sample = { relativeTime, readSensorRaw(), currentDacCode };
+  stageEnd(STAGE_ADC_READ, readStart);
+  latestAdcRaw = sample.adcRaw;
+  if (!acquisitionQueue.push(sample)) {
+    droppedSamples = droppedSamples + 1;
+  }
+  scanAuxChannels(tick);
+  sampleTick = tick + 1;
+  if ((uint32_t)esp_timer_get_time() - firedUs > intervalUs) noteMissedDeadline();
+  
+  xTaskNotifyGive(storageTaskHandle);
+}
+
+uint16_t readSensorRaw() {
+  return readAdcAveraged(oversampleShift);
+}
+
+uint16_t readAdcAveraged(uint8_t shift) {
+  return readChannelAveraged(adcChannel, shift);
+}
+
+// Burst-reads the ADC and reduces with an integer boxcar, rounded back to 12 bits
+uint16_t readChannelAveraged(adc1_channel_t channel, uint8_t shift) {
+  uint32_t count = 1u << shift;
+  uint32_t sum = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    sum += adc1_get_raw(channel);
+  }
+  return (sum + (count >> 1)) >> shift;
+}
+
+// Reads the auxiliary channels due at `tick` straight into the open
+// channel block; a gap in ticks or a DAC 2 change starts a new block
+void scanAuxChannels(uint32_t tick) {
+  if (!channelBuilder.configured()) return;
+  uint8_t dacCode = auxDacCode;
+  if (!channelBuilder.continues(tick, dacCode)) {
+    submitChannelBlock();
+    uint8_t* block;
+    if (!freeChannelBlocks.pop(block)) {
+      droppedChannelTicks = droppedChannelTicks + 1;
+      return;
+    }
+    channelBuilder.begin(block, tick, dacCode);
+  }
+  const ChannelLayout& layout = channelBuilder.blockLayout();
+  for (size_t c = 0; c < layout.channelCount; c++) {
+    if (channelBuilder.due(c, tick)) {
+      channelBuilder.put(c, readChannelAveraged(auxAdcChannels[channelAux[c]], oversampleShift));
+    }
+  }
+  if (channelBuilder.endTick()) submitChannelBlock();
+}
+
+// Producer side of filledChannelBlocks; acquisition task only
+void submitChannelBlock() {
+  uint8_t* block = channelBuilder.finish();
+  if (block) filledChannelBlocks.push(block);  // Cannot overflow: the pool is the ring's size
+}
+
+// Caller must hold storageMutex
+void drainChannelBlocks() {
+  uint8_t* block;
+  while (filledChannelBlocks.pop(block)) {
+    if (runIsOpen()) appendChannelBlock(block);
+    freeChannelBlocks.push(block);
+  }
+}
+
+// Arms the acquisition task for a run's channel set; sampling must be
+// stopped (every pool block goes back to the free list)
+bool setupChannels(const ChannelFileHeader& header) {
+  channelBuilder.configure(ChannelFileHeader{});
+  filledChannelBlocks.clear();
+  freeChannelBlocks.clear();
+  for (size_t i = 0; i < CHANNEL_POOL_BLOCKS; i++) {
+    freeChannelBlocks.push(channelPool[i]);
+  }
+  for (size_t c = 0; c < header.channelCount; c++) {
+    size_t aux = 0;
+    while (aux < MAX_AUX_CHANNELS && AUX_ADC_PINS[aux] != header.pins[c]) aux++;
+    if (aux == MAX_AUX_CHANNELS) return false;
+    channelAux[c] = aux;
+  }
+  return channelBuilder.configure(header);
+}
+
+// 's' on a stored run: carries on with the channel set it was started with
+void resumeChannels() {
+  const RunInfo* run = latestRun();
+  File file;
+  ChannelFileHeader header;
+  if (run && openChannelFile(*run, file, header)) {
     file.close();
+    setupChannels(header);
+  } else {
+    setupChannels(ChannelFileHeader{});
+  }
+}
+
+// Pinned to ACQUISITION_CORE above every other task; fixed period from
+// vTaskDelayUntil, integer-only update, never touches Serial or flash
+void controlTask(void* arg) {
+  const TickType_t period = pdMS_TO_TICKS(CONTROL_PERIOD_MS);
+  TickType_t lastWake = xTaskGetTickCount();
+  for (;;) {
+    vTaskDelayUntil(&lastWake, period);
+    if (!closedLoop) continue;
+    uint32_t start = stageStart();
     
-    if (fileSize >= MAX_FILE_SIZE) {
-      Serial.println("WARNING: Max file size reached. Stopping logging.");
-      loggingEnabled = false;
+    // The DMA capture owns ADC1 while it runs; use its latest code then
+    uint16_t raw = captureActive ? latestAdcRaw : readAdcAveraged(CONTROL_OVERSAMPLE_SHIFT);
+    uint16_t measurement = calibratedDmv(raw);
+    if (controlRestart) {
+      controlRestart = false;
+      pid.configure(config.kp, config.ki, config.kd, CONTROL_PERIOD_MS * 1000, 0, DAC_MAX_CODE, FULL_SCALE_DMV, DAC_MAX_CODE);
+      pid.reset(measurement, currentDacCode);
+    }
+    writeDacCode((uint8_t)pid.update(controlTarget, measurement));
+    stageEnd(STAGE_CONTROL, start);
+  }
+}
+
+// Pinned to ACQUISITION_CORE; runs the DMA capture between startCapture() and stopCapture()
+void captureTask(void* arg) {
+  static CaptureBlock overflowBlock;  // Keeps the driver drained when storage falls behind
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (!beginAdcCapture(adcChannel, CAPTURE_SAMPLE_RATE_HZ)) {
+      captureActive = false;
+    }
+    
+    CaptureBlock* pooled = nullptr;
+    while (captureActive) {
+      if (!pooled && !freeCaptureBlocks.pop(pooled)) pooled = nullptr;
+      CaptureBlock* block = pooled ? pooled : &overflowBlock;
+      
+      if (!readAdcCapture(*block, CAPTURE_READ_TIMEOUT_MS)) continue;
+      decimateCaptureBlock(*block, captureShift);
+      block->firstIndex = captureIndex;
+      captureIndex += block->count;
+      
+      // Step or profile changes, aligned to a block boundary
+      applySchedule(block->firstIndex);
+      block->dacCode = currentDacCode;
+      if (block->count > 0) latestAdcRaw = block->codes[block->count - 1];
+      
+      if (pooled) {
+        filledCaptureBlocks.push(pooled);
+        pooled = nullptr;
+        xTaskNotifyGive(storageTaskHandle);
+      } else {
+        droppedSamples = droppedSamples + block->count;
+        resetCaptureDecimation();  // The next group starts after the gap
+      }
+    }
+    
+    // An unused pooled block goes back through storage as an empty block
+    if (pooled) {
+      pooled->count = 0;
+      filledCaptureBlocks.push(pooled);
+    }
+    endAdcCapture();
+    captureTaskIdle = true;
+  }
+}
+
+void startCapture() {
+  if (captureActive || loggingEnabled) return;
+  captureActive = true;
+  captureTaskIdle = false;
+  xTaskNotifyGive(captureTaskHandle);
+}
+
+// Caller must hold storageMutex
+void stopCapture() {
+  if (captureTaskIdle) return;
+  captureActive = false;
+  while (!captureTaskIdle) delay(1);  // Bounded by CAPTURE_READ_TIMEOUT_MS
+  drainCaptureBlocks();
+  closeRun();
+}
+
+// Writes filled capture blocks and hands them back to the capture task
+void drainCaptureBlocks() {
+  CaptureBlock* block;
+  while (filledCaptureBlocks.pop(block)) {
+    logCaptureBlock(*block);
+    freeCaptureBlocks.push(block);
+  }
+}
+
+void logCaptureBlock(const CaptureBlock& block) {
+  if (block.count == 0) return;
+  
+  // Microsecond timestamps wrap after ~71 min: carry on in a new run first
+  if ((uint64_t)(block.firstIndex - captureRunBase + block.count) * captureIntervalUs > UINT32_MAX &&
+      !rollCaptureRun(block.firstIndex)) {
+    return;
+  }
+  
+  // Whole block goes out in one write
+  static LogRecord records[CAPTURE_BLOCK_SAMPLES];
+  for (size_t i = 0; i < block.count; i++) {
+    records[i].timestamp = (block.firstIndex - captureRunBase + i) * captureIntervalUs;
+    records[i].adcRaw = block.codes[i];
+    records[i].dacCode = block.dacCode;
+    trackSample(records[i].timestamp, records[i].adcRaw, records[i].dacCode);
+    identifySample(records[i], true);
+  }
+  if (!writeRecords(records, block.count)) {
+    if (captureActive) {
+      Serial.println("WARNING: Storage full. Stopping capture.");
+      captureActive = false;
+    }
+    return;
+  }
+  
+  for (size_t i = 0; i < block.count; i++) {
+    netSample(records[i], LOG_FLAG_TIMESTAMP_US);
+  }
+  
+  if (telemetryEnabled()) {
+    for (size_t i = 0; i < block.count; i++) {
+      telemetrySample(records[i], LOG_FLAG_TIMESTAMP_US);
+    }
+    flushTelemetry();
+    sampleCount += block.count;
+    return;
+  }
+  
+  // Print to serial (about once a second)
+  unsigned long previousSeconds = (unsigned long)((uint64_t)block.firstIndex * captureIntervalUs / 1000000);
+  sampleCount += block.count;
+  unsigned long currentSeconds = (unsigned long)((uint64_t)(block.firstIndex + block.count) * captureIntervalUs / 1000000);
+  if (currentSeconds != previousSeconds && block.count > 0) {
+    uint32_t start = stageStart();
+    Serial.printf("[%lu] t=%lu ms, Setpoint=%.2fV, Sensor=%.3fV\n",
+                  sampleCount, currentSeconds * 1000,
+                  dacCodeToVoltage(block.dacCode), adcToVoltage(block.codes[block.count - 1]));
+    stageEnd(STAGE_SERIAL_OUTPUT, start);
+  }
+}
+
+// Closes the capture run and continues in a new one starting at capture
+// sample `firstIndex`; the schedule keeps running on the capture index
+bool rollCaptureRun(uint32_t firstIndex) {
+  const RunInfo* run = latestRun();
+  if (!run || !runIsOpen()) return false;
+  uint16_t flags = run->flags & (LOG_FLAG_TIMESTAMP_US | LOG_FLAG_COMPRESSED | LOG_FLAG_BLOCK_CRC);
+  if (!startRun(captureIntervalUs, flags, run->setpointCode)) {
+    Serial.println("ERROR: Could not roll the capture run (storage full?). Stopping capture.");
+    captureActive = false;
+    return false;
+  }
+  captureRunBase = firstIndex;
+  identifyRun++;
+  identifySkipped = 0;
+  runStats.reset();
+  stepTracker.reset();
+  metricsSetpointKnown = false;
+  Serial.printf(">>> Capture time base full: continuing in run %u <<<\n", latestRun()->runId);
+  return true;
+}
+
+// appendRecords(), timed as the flash stage
+bool writeRecords(const LogRecord* records, size_t count) {
+  uint32_t start = stageStart();
+  bool ok = appendRecords(records, count);
+  stageEnd(STAGE_FLASH_APPEND, start);
+  return ok;
+}
+
+void startSampling() {
+  if (loggingEnabled || captureActive || !sampleTimer) return;
+  loggingEnabled = true;
+  esp_timer_start_periodic(sampleTimer, config.samplingIntervalMs * 1000ULL);
+  if (!bootResume) noteRunClock();  // At boot the run is known once storage is up
+}
+
+// Ties the run time of the logging run to the RTC clock for finishBoot()
+void noteRunClock() {
+  const RunInfo* run = latestRun();
+  if (run) setRunClock(run->runId, (sampleTick + resumeTickOffset) * config.samplingIntervalMs);
+}
+
+// Caller must hold storageMutex
+void stopSampling() {
+  if (!loggingEnabled) return;
+  loggingEnabled = false;
+  esp_timer_stop(sampleTimer);
+  // The acquisition task finishes any sample in progress, then hands over the open block
+  channelFlushPending = true;
+  xTaskNotifyGive(acquisitionTaskHandle);
+  while (channelFlushPending) delay(1);
+  drainAcquisitionQueue();
+  drainChannelBlocks();
+  preTriggerBuffer.clear();  // History without an event is not kept
+  postRemaining = 0;
+  flushSamples();
+  closeRun();
+}
+
+void drainAcquisitionQueue() {
+  Sample sample;
+  while (acquisitionQueue.pop(sample)) {
+    sample.timestamp += resumeTickOffset * config.samplingIntervalMs;
+    // Log to file (timestamp, setpoint, sensor reading)
+    if (triggerMode) {
+      eventSample(sample);
+    } else {
+      logData(sample);
+    }
+    LogRecord record = { sample.timestamp, sample.adcRaw, sample.dacCode };
+    identifySample(record, false);
+    
+    // Live binary stream, or text to serial (every 10 samples)
+    netSample(record, 0);
+    sampleCount++;
+    if (telemetryEnabled()) {
+      telemetrySample(record, 0);
+    } else if (sampleCount % 10 == 0) {
+      uint32_t start = stageStart();
+      Serial.printf("[%lu] t=%lu ms, Setpoint=%.2fV, Sensor=%.3fV\n", 
+                    sampleCount, (unsigned long)sample.timestamp,
+                    dacCodeToVoltage(sample.dacCode), adcToVoltage(sample.adcRaw));
+      stageEnd(STAGE_SERIAL_OUTPUT, start);
+    }
+  }
+  if (telemetryEnabled()) {
+    uint32_t start = stageStart();
+    flushTelemetry();
+    stageEnd(STAGE_SERIAL_OUTPUT, start);
+  }
+}
+
+void logData(const Sample& sample) {
+  trackSample(sample.timestamp, sample.adcRaw, sample.dacCode);
+  if (!sampleBuffer.push(sample)) {
+    // Buffer full (a previous flush failed) - make room and retry
+    flushSamples();
+    if (!sampleBuffer.push(sample)) {
+      Serial.println("ERROR: Sample buffer overflow, sample dropped");
       return;
     }
   }
   
-  // Append data to file
-  file = SPIFFS.open(DATA_FILE, FILE_APPEND);
-  if (file) {
-    file.printf("%lu,%.4f,%.4f\n", timestamp, setpoint, sensorVoltage);
-    file.close();
-  } else {
-    Serial.println("ERROR: Could not open file for writing");
+  if (sampleBuffer.size() >= FLUSH_THRESHOLD) {
+    flushSamples();
+  }
+}
+
+// Run statistics and the response to the latest setpoint change
+void trackSample(uint32_t timestamp, uint16_t adcRaw, uint8_t dacCode) {
+  uint16_t setpointDmv = closedLoop ? (uint16_t)controlTarget : dacCodeToDmv(dacCode);
+  if (metricsSetpointKnown && setpointDmv != metricsSetpointDmv) stepTracker.step(timestamp);
+  metricsSetpointDmv = setpointDmv;
+  metricsSetpointKnown = true;
+  
+  uint16_t dmv = calibratedDmv(adcRaw);
+  runStats.add(dmv);
+  stepTracker.add(timestamp, dmv);
+}
+
+// Trigger mode: the last preTriggerSamples wait in RAM; an event logs them
+// plus everything up to postTriggerSamples after the latest event, and the
+// closed window is committed so it survives a reset
+void eventSample(const Sample& sample) {
+  eventSamplesSeen++;
+  uint16_t setpointDmv = closedLoop ? (uint16_t)controlTarget : dacCodeToDmv(sample.dacCode);
+  TriggerCause cause = triggerDetector.update(calibratedDmv(sample.adcRaw), setpointDmv);
+  if (triggerForced) cause = TRIGGER_MANUAL;
+  triggerForced = false;
+  
+  if (cause == TRIGGER_NONE && postRemaining == 0) {
+    if (preTriggerSamples == 0) return;
+    Sample oldest;
+    if (preTriggerBuffer.size() >= preTriggerSamples) preTriggerBuffer.pop(oldest);
+    preTriggerBuffer.push(sample);
+    return;
+  }
+  
+  if (cause != TRIGGER_NONE) {
+    if (postRemaining == 0) {
+      eventCount++;
+      Serial.printf("\n>>> EVENT %lu (%s) at t=%lu ms <<<\n\n", (unsigned long)eventCount,
+                    triggerCauseName(cause), (unsigned long)sample.timestamp);
+      Sample history;
+      while (preTriggerBuffer.pop(history)) {
+        logData(history);
+        eventSamplesLogged++;
+      }
+    }
+    postRemaining = postTriggerSamples + 1;  // Re-triggering extends the window
+  }
+  logData(sample);
+  eventSamplesLogged++;
+  if (--postRemaining == 0) {
+    flushSamples();
+    commitRun();
   }
 }
 
+void flushSamples() {
+  if (sampleBuffer.empty() || !runIsOpen()) return;
+  
+  // Pack records into one block and append it in a single call
+  static LogRecord block[FLUSH_BLOCK_SIZE / sizeof(LogRecord)];
+  const size_t blockCapacity = sizeof(block) / sizeof(block[0]);
+  size_t blockCount = 0;
+  Sample sample;
+  bool ok = true;
+  while (ok && sampleBuffer.pop(sample)) {
+    block[blockCount].timestamp = sample.timestamp;
+    block[blockCount].adcRaw = sample.adcRaw;
+    block[blockCount].dacCode = sample.dacCode;
+    if (++blockCount == blockCapacity) {
+      ok = writeRecords(block, blockCount);
+      blockCount = 0;
+    }
+  }
+  if (ok && blockCount > 0) {
+    ok = writeRecords(block, blockCount);
+  }
+  
+  if (!ok) {
+    Serial.println("WARNING: Storage full. Stopping logging.");
+    loggingEnabled = false;
+    esp_timer_stop(sampleTimer);
+    acquisitionQueue.clear();
+    sampleBuffer.clear();
+  }
+}
+
+// Exports the latest run as CSV (same columns as the old text format)
 void printFileContents() {
   Serial.println("\n========== FILE CONTENTS ==========");
-  File file = SPIFFS.open(DATA_FILE, FILE_READ);
-  if (file) {
-    while (file.available()) {
-      Serial.write(file.read());
+  const RunInfo* run = latestRun();
+  RunReader reader;
+  if (run && reader.open(*run)) {
+    const LogFileHeader& header = reader.header();
+    Serial.println(CSV_HEADER);
+    bool microseconds = header.flags & LOG_FLAG_TIMESTAMP_US;
+    LogRecord* records = exportRecords;
+    char* chunk = (char*)exportChunk;
+    size_t chunkLength = 0;
+    size_t bytesRead;
+    while ((bytesRead = reader.read((uint8_t*)records, sizeof(exportRecords))) >= sizeof(LogRecord)) {
+      size_t count = bytesRead / sizeof(LogRecord);
+      for (size_t i = 0; i < count; i++) {
+        // Rows are formatted straight into the chunk; send it when nearly full
+        if (chunkLength + MAX_ROW_LENGTH > DUMP_CHUNK_SIZE) {
+          Serial.write((const uint8_t*)chunk, chunkLength);
+          chunkLength = 0;
+        }
+        chunkLength += formatCsvRow(chunk + chunkLength, records[i], microseconds);
+      }
     }
-    file.close();
+    if (chunkLength > 0) {
+      Serial.write((const uint8_t*)chunk, chunkLength);
+    }
+    reader.close();
+  } else if (!run) {
+    Serial.println("No runs stored");
   } else {
-    Serial.println("ERROR: Could not open file for reading");
+    Serial.println("ERROR: Could not open run for reading");
   }
   Serial.println("====================================\n");
 }
 
-void clearDataFile() {
-  File file = SPIFFS.open(DATA_FILE, FILE_WRITE);
-  if (file) {
-    file.println("timestamp_ms,setpoint_v,sensor_v");
-    file.close();
-    sampleCount = 0;
-    Serial.println("Data file cleared");
+// `query <from_s> <to_s> [<every>]`: the latest run's records in a time
+// window as CSV, every n-th one. Reading starts near `from` (summaries),
+// not at the beginning of the run.
+void queryCommand(char** words, size_t count) {
+  float seconds[2] = { 0, 0 };
+  unsigned long every = 1;
+  bool valid = count == 3 || count == 4;
+  for (size_t i = 0; valid && i < 2; i++) {
+    char* end;
+    seconds[i] = strtof(words[i + 1], &end);
+    valid = end != words[i + 1] && *end == '\0' && seconds[i] >= 0;
+  }
+  if (valid && count == 4) {
+    char* end;
+    every = strtoul(words[3], &end, 10);
+    valid = end != words[3] && *end == '\0' && every > 0;
+  }
+  if (!valid || seconds[1] < seconds[0]) {
+    Serial.println("Usage: query <from_s> <to_s> [<every>]   e.g. query 60 120 10");
+    return;
+  }
+  stopCapture();
+  stopSampling();
+  flushSamples();
+  
+  Serial.println("\n========== QUERY ==========");
+  const RunInfo* run = latestRun();
+  RecordQuery query;
+  RunReader reader;
+  if (!run) {
+    Serial.println("No runs stored");
   } else {
-    Serial.println("ERROR: Could not clear file");
+    bool microseconds = run->flags & LOG_FLAG_TIMESTAMP_US;
+    query.set(seconds[0], seconds[1], every, microseconds);
+    if (!reader.openAt(*run, query.from)) {
+      Serial.println("ERROR: Could not open run for reading");
+    } else {
+      Serial.println(CSV_HEADER);
+      LogRecord* records = exportRecords;
+      char* chunk = (char*)exportChunk;
+      size_t chunkLength = 0;
+      uint32_t rows = 0;
+      size_t bytesRead;
+      while (!query.finished && (bytesRead = reader.read((uint8_t*)records, sizeof(exportRecords))) >= sizeof(LogRecord)) {
+        size_t blockRecords = bytesRead / sizeof(LogRecord);
+        for (size_t i = 0; i < blockRecords; i++) {
+          if (!query.accept(records[i])) continue;
+          if (chunkLength + MAX_ROW_LENGTH > DUMP_CHUNK_SIZE) {
+            Serial.write((const uint8_t*)chunk, chunkLength);
+            chunkLength = 0;
+          }
+          chunkLength += formatCsvRow(chunk + chunkLength, records[i], microseconds);
+          rows++;
+        }
+      }
+      if (chunkLength > 0) {
+        Serial.write((const uint8_t*)chunk, chunkLength);
+      }
+      reader.close();
+      Serial.printf("%lu rows (%lu records in range)\n", (unsigned long)rows, (unsigned long)query.matched);
+    }
   }
+  Serial.println("===========================\n");
+}
+
+// Sends the latest run as one binary log (header + all records) in
+// CRC-checked frames (see dump_format.h) at DUMP_BAUD_RATE. Compressed
+// runs go out as stored: header (LOG_FLAG_COMPRESSED) + LOG_BLOCK_SIZE blocks.
+void dumpFileBinary() {
+  const RunInfo* run = latestRun();
+  RunReader reader;
+  if (!run || !reader.open(*run, false)) {
+    Serial.println("ERROR: No run to dump");
+    return;
+  }
+  
+  // Announce at the console speed, then give the host time to switch
+  Serial.printf("\n>>> BINARY DUMP: run %u, %lu bytes at %lu baud <<<\n", run->runId,
+                (unsigned long)(sizeof(LogFileHeader) + runPayloadBytes(*run)), DUMP_BAUD_RATE);
+  Serial.flush();
+  Serial.updateBaudRate(DUMP_BAUD_RATE);
+  delay(100);
+  
+  uint8_t* payload = exportChunk;
+  uint32_t fileCrc = 0;
+  uint16_t sequence = 0;
+  memcpy(payload, &reader.header(), sizeof(LogFileHeader));
+  size_t bytesRead = sizeof(LogFileHeader) + reader.read(payload + sizeof(LogFileHeader),
+                                                         DUMP_CHUNK_SIZE - sizeof(LogFileHeader));
+  while (bytesRead > 0) {
+    DumpFrameHeader frame = { DUMP_FRAME_MAGIC, sequence++, (uint16_t)bytesRead };
+    uint32_t frameCrc = crc32Update(0, payload, bytesRead);
+    fileCrc = crc32Update(fileCrc, payload, bytesRead);
+    Serial.write((const uint8_t*)&frame, sizeof(frame));
+    Serial.write(payload, bytesRead);
+    Serial.write((const uint8_t*)&frameCrc, sizeof(frameCrc));
+    bytesRead = reader.read(payload, DUMP_CHUNK_SIZE);
+  }
+  reader.close();
+  
+  // Terminating frame carries the whole-file CRC
+  DumpFrameHeader frame = { DUMP_FRAME_MAGIC, sequence, 0 };
+  Serial.write((const uint8_t*)&frame, sizeof(frame));
+  Serial.write((const uint8_t*)&fileCrc, sizeof(fileCrc));
+  Serial.flush();
+  
+  delay(100);
+  Serial.updateBaudRate(SERIAL_BAUD_RATE);
+  Serial.printf("\n>>> BINARY DUMP DONE: CRC-32 %08lX <<<\n", (unsigned long)fileCrc);
+}
+
+// Deletes every stored run
+void clearDataFile() {
+  sampleBuffer.clear();  // Drop samples that belong to the old runs
+  clearAllRuns();
+  sampleCount = 0;
+  Serial.println("All runs cleared");
+}
+
+// Opens a new run for the test about to start
+bool beginRun(uint32_t samplingIntervalUs, uint16_t flags) {
+  if (!buildSchedule(samplingIntervalUs)) {
+    Serial.printf("ERROR: Profile needs more than %u setpoint changes at this rate\n", PROFILE_MAX_ENTRIES);
+    return false;
+  }
+  sampleBuffer.clear();
+  if (config.compressLog) flags |= LOG_FLAG_COMPRESSED | LOG_FLAG_BLOCK_CRC;
+  
+  // Auxiliary channels ride on the sample timer, so continuous timer runs only
+  ChannelFileHeader channels = makeChannelHeader(samplingIntervalUs);
+  if (!(flags & (LOG_FLAG_TIMESTAMP_US | LOG_FLAG_EVENTS))) {
+    for (size_t i = 0; i < MAX_AUX_CHANNELS; i++) {
+      if (config.auxDecimation[i] == 0) continue;
+      channels.pins[channels.channelCount] = AUX_ADC_PINS[i];
+      channels.decimation[channels.channelCount++] = config.auxDecimation[i];
+    }
+  }
+  if (channels.channelCount > 0) flags |= LOG_FLAG_CHANNELS;
+  setupChannels(ChannelFileHeader{});
+  
+  if (!startRun(samplingIntervalUs, flags, voltageToDacCode(config.stepVoltage))) {
+    Serial.println("ERROR: Could not start run (storage full?)");
+    return false;
+  }
+  if (channels.channelCount > 0 && (!startChannels(channels) || !setupChannels(channels))) {
+    Serial.println("ERROR: Could not create the channel file, auxiliary channels not logged");
+    setupChannels(ChannelFileHeader{});
+  }
+  sampleCount = 0;
+  resumeTickOffset = 0;
+  identifyRun++;
+  identifySkipped = 0;
+  runStats.reset();
+  stepTracker.reset();
+  metricsSetpointKnown = false;
+  Serial.printf("Run %u started\n", latestRun()->runId);
+  return true;
 }
 
 void printFileInfo() {
   Serial.println("\n---------- FILE INFO ----------");
   
-  size_t totalBytes = SPIFFS.totalBytes();
-  size_t usedBytes = SPIFFS.usedBytes();
+  size_t totalBytes = storageTotalBytes();
+  size_t usedBytes = storageUsedBytes();
   
-  Serial.printf("SPIFFS Total: %u bytes\n", totalBytes);
-  Serial.printf("SPIFFS Used:  %u bytes\n", usedBytes);
-  Serial.printf("SPIFFS Free:  %u bytes\n", totalBytes - usedBytes);
+  Serial.printf("%s Total: %u bytes\n", storageName(), totalBytes);
+  Serial.printf("%s Used:  %u bytes\n", storageName(), usedBytes);
+  Serial.printf("%s Free:  %u bytes\n", storageName(), totalBytes - usedBytes);
   
-  File file = SPIFFS.open(DATA_FILE, FILE_READ);
-  if (file) {
-    Serial.printf("Data file size: %u bytes\n", file.size());
-    
-    // Count lines (samples)
-    size_t lines = 0;
-    while (file.available()) {
-      if (file.read() == '\n') lines++;
+  // From the run index (only a compressed run's last segment is opened for its size)
+  Serial.printf("Runs stored:  %u\n", runCount());
+  for (size_t i = 0; i < runCount(); i++) {
+    const RunInfo& run = runAt(i);
+    Serial.printf("  Run %4u: %7lu samples, %3u segs, %7lu bytes%s%s, step %.2f V, %s, boot %lu +%lu s%s\n",
+                  run.runId, (unsigned long)run.sampleCount, run.segmentCount,
+                  (unsigned long)runBytes(run), (run.flags & LOG_FLAG_COMPRESSED) ? " packed" : "",
+                  (run.flags & LOG_FLAG_CHANNELS) ? " +aux" : (run.flags & LOG_FLAG_EVENTS) ? " events" : "",
+                  dacCodeToVoltage(run.setpointCode),
+                  (run.flags & LOG_FLAG_TIMESTAMP_US) ? "fast" : "timer",
+                  (unsigned long)run.bootCount, (unsigned long)(run.startUptimeMs / 1000),
+                  run.state == RUN_OPEN ? " (open)" : "");
+  }
+  Serial.printf("Log commits:  %lu (%lu block bytes rewritten)\n", (unsigned long)commitCount(),
+                (unsigned long)commitJournalBytes());
+  printNetStatus(Serial);
+  Serial.println("-------------------------------\n");
+}
+
+// Reports the streaming FOPDT fit; replaces the tfest() round-trip in temp_station.m
+void printStepFit() {
+  StepFit fit;
+  Serial.println("\n---------- STEP FIT (FOPDT) ----------");
+  if (fittedRun != identifyRun || !stepEstimator.stepSeen()) {
+    Serial.println("No step seen yet in this run");
+  } else if (!stepEstimator.result(fit)) {
+    Serial.println("Not enough response yet (output still inside the noise band?)");
+  } else {
+    Serial.println("G(s) = K e^(-theta s) / (tau s + 1)");
+    Serial.printf("  K (gain):          %.4f V/V\n", fit.gain);
+    Serial.printf("  tau (time const):  %.3f s\n", fit.timeConstant);
+    Serial.printf("  theta (dead time): %.3f s\n", fit.deadTime);
+    Serial.printf("  Baseline:          %.4f V\n", fit.baseline);
+    Serial.printf("  Step size:         %.3f V\n", fit.stepSize);
+    Serial.printf("  Samples fitted:    %lu\n", (unsigned long)fit.samples);
+  }
+  if (stepEstimator.isFrozen()) {
+    Serial.println("  (setpoint changed again after the step; fit frozen)");
+  }
+  if (closedLoop) {
+    Serial.println("  (closed loop active; samples are not being fitted)");
+  }
+  if (identifySkipped > 0) {
+    Serial.printf("  (%lu samples skipped while the fit fell behind)\n", (unsigned long)identifySkipped);
+  }
+  Serial.println("--------------------------------------\n");
+}
+
+// Storage task, integer only: hands a logged sample to the fit in loop()
+void identifySample(const LogRecord& record, bool microseconds) {
+  if (closedLoop) return;
+  IdentifySample sample = { record.timestamp, record.adcRaw, record.dacCode, identifyRun, microseconds };
+  if (!identifyQueue.push(sample)) identifySkipped++;
+}
+
+// loop(): the double-precision FOPDT update, off the sampling and storage path
+void drainIdentifyQueue() {
+  IdentifySample sample;
+  while (identifyQueue.pop(sample)) {
+    if (sample.run != fittedRun) {
+      stepEstimator.reset();
+      fittedRun = sample.run;
+    }
+    double t = sample.timestamp * (sample.microseconds ? 1e-6 : 1e-3);
+    stepEstimator.addSample(t, adcToVoltage(sample.adcRaw), dacCodeToVoltage(sample.dacCode));
+  }
+}
+
+// Streaming statistics of the current (or last) run; no log read-back
+void printMetrics() {
+  const RunInfo* run = latestRun();
+  bool microseconds = run && (run->flags & LOG_FLAG_TIMESTAMP_US);
+  const char* unit = microseconds ? "us" : "ms";
+  Serial.println("\n---------- RUN METRICS ----------");
+  if (runStats.count() == 0) {
+    Serial.println("No samples logged in this run");
+    Serial.println("---------------------------------\n");
+    return;
+  }
+  const float scale = 1.0f / DMV_PER_VOLT;
+  Serial.printf("Samples:        %lu\n", (unsigned long)runStats.count());
+  Serial.printf("Mean:           %.4f V (std %.4f V)\n", runStats.mean() * scale, runStats.stddev() * scale);
+  Serial.printf("Min / max:      %.4f / %.4f V\n", runStats.min() * scale, runStats.max() * scale);
+  StepMetrics step;
+  if (!stepTracker.stepSeen()) {
+    Serial.println("No setpoint change seen yet in this run");
+  } else if (!stepTracker.result(step)) {
+    Serial.println("Not enough response yet (too few samples or too small a change)");
+  } else {
+    Serial.printf("Initial:        %.4f V\n", step.initialDmv * scale);
+    Serial.printf("Final:          %.4f V%s\n", step.finalDmv * scale, step.settled ? "" : " (not settled)");
+    Serial.printf("Peak:           %.4f V (overshoot %.1f %%)\n", step.peakDmv * scale, step.overshootPercent);
+    Serial.printf("Rise 10-90%%:    %lu %s\n", (unsigned long)step.riseTime, unit);
+    Serial.printf("Settling 2%%:    %lu %s\n", (unsigned long)step.settlingTime, unit);
+    Serial.printf("Since step:     %lu samples\n", (unsigned long)step.samples);
+  }
+  Serial.println("---------------------------------\n");
+}
+
+// Word commands (caller holds storageMutex):
+//   set <name> <value> [<name> <value> ...]   e.g. set rate 10 wait 5000
+//   step [<base>->]<step> [@<wait_ms>]         e.g. step 0->2.5 @3000
+//   stream <N> | stream off                    binary telemetry, every Nth sample
+//   wifi [<ssid> [<password>] | off]           data server (see net_server.h)
+//   profile [hold|ramp|prbs ... | clear | load <file> | save <file>]
+//   stats [reset]                              hot-path latency histograms
+//   show | defaults | cal [<volts> | clear] | help
+void handleWordCommand(char** words, size_t count) {
+  const char* command = words[0];
+  if (strcasecmp(command, "set") == 0) {
+    if (count < 3 || (count - 1) % 2 != 0) {
+      Serial.println("Usage: set <name> <value> [<name> <value> ...] ('show' lists names)");
+      return;
+    }
+    const char* names[MAX_COMMAND_WORDS / 2];
+    const char* values[MAX_COMMAND_WORDS / 2];
+    size_t pairs = 0;
+    for (size_t i = 1; i + 1 < count; i += 2, pairs++) {
+      names[pairs] = words[i];
+      values[pairs] = words[i + 1];
+    }
+    setParameters(names, values, pairs);
+  } else if (strcasecmp(command, "step") == 0) {
+    stepCommand(words, count);
+  } else if (strcasecmp(command, "show") == 0 || strcasecmp(command, "get") == 0) {
+    Serial.println("\n---------- PARAMETERS ----------");
+    printConfig(Serial);
+    Serial.println("--------------------------------\n");
+  } else if (strcasecmp(command, "defaults") == 0) {
+    if (testInProgress()) {
+      Serial.println("ERROR: Test in progress. Press 'r' to reset first.");
+      return;
+    }
+    resetConfig();
+    applyConfig();
+    Serial.println("Parameters back to defaults");
+  } else if (strcasecmp(command, "stream") == 0 && count == 2) {
+    const char* name = "stream";
+    const char* value = strcasecmp(words[1], "off") == 0 ? "0" : words[1];
+    setParameters(&name, &value, 1);
+  } else if (strcasecmp(command, "wifi") == 0) {
+    if (count == 1) {
+      printNetStatus(Serial);
+    } else if (count == 2 && strcasecmp(words[1], "off") == 0) {
+      setWifiCredentials("", "");
+      Serial.println("Wi-Fi off, credentials cleared");
+    } else if (count <= 3) {
+      setWifiCredentials(words[1], count == 3 ? words[2] : "");
+      Serial.printf("Wi-Fi connecting to '%s' (saved; 'wifi' shows status)\n", words[1]);
+    } else {
+      Serial.println("Usage: wifi [<ssid> [<password>] | off]");
+    }
+  } else if (strcasecmp(command, "cal") == 0) {
+    calibrationCommand(words, count);
+  } else if (strcasecmp(command, "profile") == 0) {
+    profileCommand(words, count);
+  } else if (strcasecmp(command, "stats") == 0) {
+    statsCommand(words, count);
+  } else if (strcasecmp(command, "channels") == 0) {
+    channelsCommand(words, count);
+  } else if (strcasecmp(command, "trigger") == 0) {
+    triggerCommand(words, count);
+  } else if (strcasecmp(command, "query") == 0) {
+    queryCommand(words, count);
+  } else if (strcasecmp(command, "metrics") == 0) {
+    printMetrics();
+  } else if (strcasecmp(command, "summary") == 0) {
+    summaryCommand(words, count);
+  } else if (strcasecmp(command, "help") == 0) {
+    printHelp();
+  } else {
+    Serial.printf("ERROR: Unknown command '%s' (try 'help')\n", command);
+  }
+}
+
+// Applies a batch of parameters together and reports the first bad one
+void setParameters(const char* const* names, const char* const* values, size_t count) {
+  const char* failed = nullptr;
+  switch (setConfigValues(names, values, count, testInProgress(), &failed)) {
+    case CONFIG_OK:
+      applyConfig();
+      for (size_t i = 0; i < count; i++) {
+        Serial.printf("%s = %s\n", names[i], values[i]);
+      }
+      break;
+    case CONFIG_UNKNOWN:
+      Serial.printf("ERROR: Unknown parameter '%s' ('show' lists them)\n", failed);
+      break;
+    case CONFIG_INVALID:
+      Serial.printf("ERROR: Bad value for '%s'\n", failed);
+      break;
+    case CONFIG_LOCKED:
+      Serial.printf("ERROR: '%s' is fixed during a test. Press 'r' to reset first.\n", failed);
+      break;
+  }
+}
+
+// step [<base>->]<step> [@<wait_ms>]: the whole step test in one line
+void stepCommand(char** words, size_t count) {
+  if (count < 2 || count > 3 || (count == 3 && words[2][0] != '@')) {
+    Serial.println("Usage: step [<base>->]<step> [@<wait_ms>]  e.g. step 0->2.5 @3000");
+    return;
+  }
+  const char* names[3];
+  const char* values[3];
+  size_t pairs = 0;
+  char* spec = words[1];
+  char* arrow = strstr(spec, "->");
+  if (arrow) {
+    *arrow = '\0';
+    names[pairs] = "base";
+    values[pairs++] = spec;
+    spec = arrow + 2;
+  }
+  names[pairs] = "step";
+  values[pairs++] = spec;
+  if (count == 3) {
+    names[pairs] = "wait";
+    values[pairs++] = words[2] + 1;
+  }
+  setParameters(names, values, pairs);
+}
+
+// cal <volts>: pair the typed reference with a heavily oversampled reading
+// cal clear:   drop all user points
+void calibrationCommand(char** words, size_t count) {
+  if (count == 1) {
+    printCalibration();
+  } else if (loggingEnabled || captureActive || closedLoop) {
+    // Both subcommands rebuild the table the sampling and control tasks read
+    Serial.println("Stop logging ('s') and closed loop ('l') before calibrating.");
+  } else if (strcasecmp(words[1], "clear") == 0) {
+    clearCalibrationPoints();
+    Serial.println("User calibration cleared (eFuse characterization only)");
+  } else {
+    char* end;
+    float volts = strtof(words[1], &end);
+    if (end == words[1] || *end != '\0' || volts <= 0 || volts > 3.3f) {
+      Serial.println("ERROR: Reference must be between 0 and 3.3 V");
+      return;
+    }
+    uint16_t code = readAdcAveraged(MAX_OVERSAMPLE_SHIFT);
+    float before = adcToVoltage(code);
+    if (addCalibrationPoint(code, voltsToDmv(volts))) {
+      Serial.printf("Point added: code %u, %.4f V (was %.4f V)\n", code, volts, before);
+    } else {
+      Serial.printf("ERROR: Calibration full (%u points); 'cal clear' resets it\n", MAX_CAL_POINTS);
+    }
+  }
+}
+
+// profile                     list the segments
+// profile hold|ramp|prbs ...  append a segment (see setpoint_profile.h)
+// profile clear               back to the single base -> step test
+// profile load|save <file>    one segment per line, '#' comments
+void profileCommand(char** words, size_t count) {
+  if (count == 1) {
+    printProfile();
+    return;
+  }
+  if (testInProgress()) {
+    Serial.println("ERROR: Test in progress. Press 'r' to reset first.");
+    return;
+  }
+  if (strcasecmp(words[1], "clear") == 0 && count == 2) {
+    profile.clear();
+    Serial.println("Profile cleared ('g' runs the single step again)");
+  } else if (strcasecmp(words[1], "load") == 0 && count == 3) {
+    if (loadProfile(words[2])) printProfile();
+  } else if (strcasecmp(words[1], "save") == 0 && count == 3) {
+    if (saveProfile(words[2])) Serial.printf("Profile saved to %s\n", words[2]);
+  } else {
+    ProfileSegment segment;
+    if (!parseProfileSegment(words + 1, count - 1, segment)) {
+      Serial.println("Usage: profile hold <V> <ms> | ramp <V> <ms> | prbs <low V> <high V> <bit ms> <order 2-12>");
+    } else if (!profile.add(segment)) {
+      Serial.printf("ERROR: Profile full (%u segments)\n", PROFILE_MAX_SEGMENTS);
+    } else {
+      Serial.printf("Segment %u added, profile %.1f s\n", profile.segmentCount(), profile.lengthMs() / 1000.0f);
+    }
+  }
+}
+
+// Replaces the profile with the segments in `path`; unchanged on any error
+bool loadProfile(const char* path) {
+  File file = storageFs().open(path, FILE_READ);
+  if (!file) {
+    Serial.printf("ERROR: Cannot open %s\n", path);
+    return false;
+  }
+  SetpointProfile loaded;
+  LineReader<COMMAND_LINE_LENGTH> reader;
+  unsigned lineNumber = 0;
+  bool ok = true;
+  while (ok) {
+    int c = file.read();
+    bool complete = c < 0 ? reader.feed('\n') : reader.feed((char)c);
+    if (complete) {
+      lineNumber++;
+      char* words[MAX_COMMAND_WORDS];
+      size_t count = 0;
+      char* save = nullptr;
+      for (char* word = strtok_r(reader.line(), " \t", &save); word && count < MAX_COMMAND_WORDS;
+           word = strtok_r(nullptr, " \t", &save)) {
+        words[count++] = word;
+      }
+      ProfileSegment segment;
+      if (count > 0 && words[0][0] != '#' &&
+          (!parseProfileSegment(words, count, segment) || !loaded.add(segment))) {
+        Serial.printf("ERROR: %s line %u: bad segment or too many segments\n", path, lineNumber);
+        ok = false;
+      }
+      reader.clear();
+    }
+    if (c < 0) break;
+  }
+  file.close();
+  if (ok) profile = loaded;
+  return ok;
+}
+
+bool saveProfile(const char* path) {
+  File file = storageFs().open(path, FILE_WRITE);
+  if (!file) {
+    Serial.printf("ERROR: Cannot write %s\n", path);
+    return false;
+  }
+  char line[64];
+  for (size_t i = 0; i < profile.segmentCount(); i++) {
+    int length = formatProfileSegment(line, sizeof(line), profile.segment(i));
+    file.write((const uint8_t*)line, length);
+    file.write('\n');
+  }
+  file.close();
+  return true;
+}
+
+void printProfile() {
+  Serial.println("\n---------- SETPOINT PROFILE ----------");
+  if (profile.segmentCount() == 0) {
+    Serial.printf("None: single step %.2f V -> %.2f V after %lu ms\n",
+                  config.baseVoltage, config.stepVoltage, (unsigned long)config.initialWaitMs);
+  }
+  char line[64];
+  for (size_t i = 0; i < profile.segmentCount(); i++) {
+    formatProfileSegment(line, sizeof(line), profile.segment(i));
+    Serial.printf("  %2u: %s\n", i + 1, line);
+  }
+  if (profile.segmentCount() > 0) {
+    Serial.printf("Length %.1f s from %.2f V, then holds the last level\n",
+                  profile.lengthMs() / 1000.0f, config.baseVoltage);
+  }
+  if (testInProgress()) {
+    Serial.printf("Running: %u/%u changes applied\n", schedulePosition, scheduleLength);
+  }
+  Serial.println("--------------------------------------\n");
+}
+
+// stats: per-stage latency table and histograms; stats reset: start over
+void statsCommand(char** words, size_t count) {
+  if (count == 2 && strcasecmp(words[1], "reset") == 0) {
+    resetStageStats();
+    resetLowPowerStats();
+    Serial.println("Stats cleared");
+    return;
+  }
+  Serial.println("\n---------- HOT-PATH STATS ----------");
+  printStageStats(Serial, config.samplingIntervalMs);
+  Serial.printf("Dropped samples: %lu\n", (unsigned long)droppedSamples);
+  printLowPowerStats(Serial);
+  Serial.println("------------------------------------\n");
+}
+
+// `channels`: auxiliary channel setup; `channels csv` exports the latest run's channels
+void channelsCommand(char** words, size_t count) {
+  if (count == 2 && strcasecmp(words[1], "csv") == 0) {
+    stopCapture();
+    stopSampling();
+    flushSamples();
+    printChannelContents();
+    return;
+  }
+  Serial.println("\n---------- AUX CHANNELS ----------");
+  for (size_t i = 0; i < MAX_AUX_CHANNELS; i++) {
+    uint16_t every = config.auxDecimation[i];
+    if (every == 0) {
+      Serial.printf("  aux%u  GPIO %d: off\n", (unsigned)(i + 1), AUX_ADC_PINS[i]);
+    } else {
+      Serial.printf("  aux%u  GPIO %d: every %u samples (%lu ms)\n", (unsigned)(i + 1), AUX_ADC_PINS[i],
+                    every, (unsigned long)(every * config.samplingIntervalMs));
+    }
+  }
+  Serial.printf("Output 2:      GPIO %d at %.2f V\n", AUX_DAC_PIN, dacCodeToVoltage(auxDacCode));
+  if (channelBuilder.configured()) {
+    Serial.printf("Recording:     %lu samples per block\n", (unsigned long)channelBuilder.blockLayout().ticksPerBlock);
+  }
+  Serial.printf("Dropped ticks: %lu\n", (unsigned long)droppedChannelTicks);
+  Serial.println("----------------------------------\n");
+}
+
+// Exports the latest run's auxiliary channels as CSV, rows in time order
+void printChannelContents() {
+  Serial.println("\n========== CHANNEL CONTENTS ==========");
+  const RunInfo* run = latestRun();
+  File file;
+  ChannelFileHeader header;
+  ChannelLayout layout;
+  if (!run) {
+    Serial.println("No runs stored");
+  } else if (!openChannelFile(*run, file, header)) {
+    Serial.println("Latest run has no auxiliary channels");
+  } else if (!layout.build(header)) {
+    Serial.println("ERROR: Channel file header is invalid");
+    file.close();
+  } else {
+    Serial.println(CHANNEL_CSV_HEADER);
+    alignas(4) static uint8_t block[CHANNEL_BLOCK_SIZE];
+    char* chunk = (char*)exportChunk;
+    size_t chunkLength = 0;
+    uint32_t intervalMs = header.samplingIntervalUs / 1000;
+    ChannelBlockReader reader;
+    while (file.read(block, sizeof(block)) == sizeof(block)) {
+      if (!reader.begin(layout, block)) continue;  // Unused or torn block
+      
+      // Merge the per-channel arrays by tick
+      uint32_t next[MAX_AUX_CHANNELS] = {};
+      for (;;) {
+        size_t channel = layout.channelCount;
+        for (size_t c = 0; c < layout.channelCount; c++) {
+          if (next[c] < reader.count(c) &&
+              (channel == layout.channelCount || reader.tick(c, next[c]) < reader.tick(channel, next[channel]))) {
+            channel = c;
+          }
+        }
+        if (channel == layout.channelCount) break;
+        if (chunkLength + MAX_ROW_LENGTH > DUMP_CHUNK_SIZE) {
+          Serial.write((const uint8_t*)chunk, chunkLength);
+          chunkLength = 0;
+        }
+        uint32_t i = next[channel]++;
+        chunkLength += formatChannelCsvRow(chunk + chunkLength, reader.tick(channel, i) * intervalMs,
+                                           header.pins[channel], reader.code(channel, i),
+                                           reader.blockHeader().dacCode);
+      }
+    }
+    if (chunkLength > 0) {
+      Serial.write((const uint8_t*)chunk, chunkLength);
     }
-    Serial.printf("Total samples: %u\n", lines > 0 ? lines - 1 : 0);
     file.close();
   }
-  Serial.println("-------------------------------\n");
+  Serial.println("======================================\n");
+}
+
+// `summary [level]`: the latest run's block summaries as CSV, 2^level
+// (0..SUMMARY_MAX_LEVEL) merged per row
+void summaryCommand(char** words, size_t count) {
+  unsigned long level = 0;
+  char* end = nullptr;
+  if (count == 2) level = strtoul(words[1], &end, 10);
+  if (count > 2 || (count == 2 && (end == words[1] || *end != '\0')) || level > SUMMARY_MAX_LEVEL) {
+    Serial.printf("Usage: summary [0..%u]\n", (unsigned)SUMMARY_MAX_LEVEL);
+    return;
+  }
+  stopCapture();
+  stopSampling();
+  flushSamples();
+  
+  Serial.println("\n========== RUN SUMMARY ==========");
+  const RunInfo* run = latestRun();
+  File file;
+  if (!run) {
+    Serial.println("No runs stored");
+  } else if (!openSummaryFile(*run, file)) {
+    Serial.println("Latest run has no summary file");
+  } else {
+    bool microseconds = run->flags & LOG_FLAG_TIMESTAMP_US;
+    Serial.printf("%s,samples,min_V,mean_V,max_V,setpoint_min_V,setpoint_max_V\n",
+                  microseconds ? "timestamp_us" : "timestamp_ms");
+    uint32_t group = 1u << level;
+    RunSummary merged = {};
+    uint32_t merges = 0;
+    RunSummary next;
+    for (;;) {
+      bool more = file.read((uint8_t*)&next, sizeof(next)) == sizeof(next);
+      if (more) {
+        mergeSummary(merged, next);
+        merges++;
+      }
+      if ((!more || merges == group) && merged.count > 0) {
+        Serial.printf("%lu,%u,%.4f,%.4f,%.4f,%.3f,%.3f\n", (unsigned long)merged.firstTimestamp, merged.count,
+                      adcToVoltage(merged.adcMin), adcToVoltage(merged.adcMean), adcToVoltage(merged.adcMax),
+                      dacCodeToVoltage(merged.dacMin), dacCodeToVoltage(merged.dacMax));
+        merged = RunSummary();
+        merges = 0;
+      }
+      if (!more) break;
+    }
+    file.close();
+  }
+  Serial.println("=================================\n");
+}
+
+// `trigger arm` samples like 'g' but logs only event windows ('r' ends it);
+// `trigger now` forces an event, `trigger` shows the counters
+void triggerCommand(char** words, size_t count) {
+  if (count == 2 && strcasecmp(words[1], "arm") == 0) {
+    if (testInProgress()) {
+      Serial.println("Test already running or step applied. Press 'r' to reset first.");
+      return;
+    }
+    uint32_t intervalMs = config.samplingIntervalMs;
+    if (!beginRun(intervalMs * 1000, LOG_FLAG_EVENTS)) return;
+    if (profile.segmentCount() == 0) scheduleLength = 0;  // Monitor the present setpoint, no step
+    preTriggerSamples = config.preTriggerMs / intervalMs;
+    if (preTriggerSamples > PRETRIGGER_CAPACITY) preTriggerSamples = PRETRIGGER_CAPACITY;
+    postTriggerSamples = config.postTriggerMs / intervalMs;
+    triggerDetector.configure(config.triggerSlopeMvPerS, intervalMs * 1000, config.triggerOnSetpoint);
+    preTriggerBuffer.clear();
+    postRemaining = 0;
+    triggerForced = false;
+    eventCount = 0;
+    eventSamplesSeen = 0;
+    eventSamplesLogged = 0;
+    triggerMode = true;
+    
+    acquisitionQueue.clear();
+    sampleTick = 0;
+    droppedSamples = 0;
+    stepAnnounced = false;
+    captureMode = false;
+    startSampling();
+    Serial.printf("\n>>> TRIGGER ARMED - logging %lu ms before and %lu ms after each event <<<\n\n",
+                  (unsigned long)(preTriggerSamples * intervalMs), (unsigned long)(postTriggerSamples * intervalMs));
+  } else if (count == 2 && strcasecmp(words[1], "now") == 0) {
+    if (!triggerMode || !loggingEnabled) {
+      Serial.println("ERROR: Trigger not armed ('trigger arm')");
+      return;
+    }
+    triggerForced = true;
+  } else if (count == 1) {
+    Serial.printf("Trigger:  %s, slope %.1f mV/s%s, setpoint changes %s\n",
+                  triggerMode && loggingEnabled ? "ARMED" : "off", config.triggerSlopeMvPerS,
+                  config.triggerSlopeMvPerS > 0 ? "" : " (off)", config.triggerOnSetpoint ? "on" : "off");
+    Serial.printf("Events:   %lu, %lu of %lu samples logged%s\n", (unsigned long)eventCount,
+                  (unsigned long)eventSamplesLogged, (unsigned long)eventSamplesSeen,
+                  postRemaining > 0 ? " (window open)" : "");
+  } else {
+    Serial.println("Usage: trigger [arm|now]");
+  }
+}
+
+void printCalibration() {
+  Serial.println("\n---------- ADC CALIBRATION ----------");
+  Serial.printf("Source: %s, %u user points\n", calibrationSource(), calibrationPointCount());
+  for (size_t i = 0; i < calibrationPointCount(); i++) {
+    const CalPoint& point = calibrationPoint(i);
+    Serial.printf("  code %4u -> %.4f V\n", point.code, point.dmv * (1.0f / DMV_PER_VOLT));
+  }
+  Serial.printf("Apply a known voltage to GPIO %d, then 'cal <volts>' ('cal clear' resets)\n", ADC_PIN);
+  Serial.println("-------------------------------------\n");
 }
 
 void printHelp() {
   Serial.println("\n----------------------------------------");
   Serial.println("Commands:");
   Serial.println("  'g' - GO: Start step response test");
-  Serial.println("  'r' - RESET: Set setpoint to 0V");
+  Serial.println("  'f' - FAST: Step response test on high-rate DMA capture");
+  Serial.println("  'r' - RESET: Set setpoint back to base");
   Serial.println("  's' - STOP/START logging");
   Serial.println("  'p' - PRINT file contents");
-  Serial.println("  'c' - CLEAR data file");
-  Serial.println("  'i' - Show file INFO");
+  Serial.println("  'b' - BINARY dump (framed, CRC-32, fast baud)");
+  Serial.println("  'c' - CLEAR all stored runs");
+  Serial.println("  'i' - Show file INFO and stored runs");
   Serial.println("  'v' - Show current VALUES");
-  Serial.println("  '+' - Increase setpoint by 0.1V");
-  Serial.println("  '-' - Decrease setpoint by 0.1V");
+  Serial.println("  'o' - Cycle OVERSAMPLING (1/4/16/64 reads)");
+  Serial.println("  'l' - Toggle closed-LOOP PID control");
+  Serial.println("  'k' - Show ADC calibration points");
+  Serial.println("  'e' - ESTIMATE: FOPDT fit (K, tau, theta) of the step test");
+  Serial.println("  '+' - Increase setpoint (or target) by 0.1V");
+  Serial.println("  '-' - Decrease setpoint (or target) by 0.1V");
   Serial.println("  'h' - Show this HELP");
+  Serial.println("  (end keys with Enter; r i v h + - also work alone, `set keys 0` turns that off)");
+  Serial.println("Line commands (end with Enter):");
+  Serial.println("  set <name> <value> ...    e.g. set rate 10 wait 5000 (saved to NVS)");
+  Serial.println("  step [<base>->]<step> [@<ms>]  e.g. step 0->2.5 @3000");
+  Serial.println("  stream <N> | stream off   Binary telemetry of every Nth sample (COBS)");
+  Serial.println("  wifi <ssid> <pass> | off  Wi-Fi data server (/data.csv, ws /ws)");
+  Serial.println("  show | defaults           List / restore parameters");
+  Serial.println("  cal <volts> | cal clear   Add / drop ADC calibration points");
+  Serial.println("  profile hold|ramp|prbs .. Append a setpoint segment ('profile' lists)");
+  Serial.println("  profile clear|load|save   Single step again / read / write a profile file");
+  Serial.println("  stats [reset]             Per-stage latency histograms, missed deadlines");
+  Serial.println("  channels [csv]            Auxiliary channels / latest run's channel data");
+  Serial.println("  trigger arm|now           Log only windows around events (set pre/post/slope/trigsp)");
+  Serial.println("  query <from> <to> [<n>]   Latest run's records from..to s as CSV, every n-th");
+  Serial.println("  metrics                   Run mean/std/min/max, rise and settling time of the last step");
+  Serial.println("  summary [level]           Latest run's block min/mean/max as CSV (2^level blocks per row)");
   Serial.println("----------------------------------------");
 }
@@ -0,0 +1,262 @@
+#include "net_server.h"
+
+#ifdef STATION_WIFI
+
+#include <WiFi.h>
+#include <AsyncTCP.h>
+#include <ESPAsyncWebServer.h>
+#include <Preferences.h>
+#include <memory>
+#include "run_store.h"
+#include "csv_format.h"
+#include "record_query.h"
+#include "telemetry_format.h"
+
+#ifndef RESPONSE_TRY_AGAIN
+#define RESPONSE_TRY_AGAIN 0xFFFFFFFF
+#endif
+
+const uint16_t HTTP_PORT = 80;
+const TickType_t FILE_LOCK_TIMEOUT = pdMS_TO_TICKS(20);  // Retry later rather than hold up the TCP task
+const size_t CSV_CHUNK_RECORDS = 128;                    // Upper bound per chunk callback
+const size_t WS_BATCH_RECORDS = 64;                      // Records per WebSocket message at most
+const unsigned long WS_FLUSH_MS = 200;                   // Oldest sample waits at most this long
+const unsigned long WS_CLEANUP_MS = 1000;
+
+static AsyncWebServer server(HTTP_PORT);
+static AsyncWebSocket socket("/ws");
+static SemaphoreHandle_t fileLock = nullptr;
+static bool serverStarted = false;
+
+// Live batch: header and records laid out exactly as sent. The storage
+// task and commands in loop() both add samples and the storage task ages
+// batches out, so every access holds batchLock; sends also happen under
+// it, which keeps messages in sequence order.
+static SemaphoreHandle_t batchLock = nullptr;
+static uint8_t wsMessage[sizeof(TelemetryHeader) + WS_BATCH_RECORDS * sizeof(LogRecord)];
+static size_t wsCount = 0;
+static uint16_t wsFlags = 0;
+static uint16_t wsSequence = 0;
+static unsigned long wsBatchStartMs = 0;
+static uint32_t wsDropped = 0;
+static unsigned long lastCleanupMs = 0;
+
+// Per-request state of a /data.csv download (freed when the response ends)
+struct CsvDownload {
+  RunReader reader;
+  RecordQuery query;            // ?from=&to= (s) and ?every=
+  bool microseconds = false;
+  bool headerSent = false;
+};
+
+// Chunk callback: formats as many whole rows as fit in this TCP window
+static size_t fillCsvChunk(CsvDownload& download, uint8_t* buffer, size_t maxLength) {
+  if (maxLength < MAX_ROW_LENGTH + strlen(CSV_HEADER) + 1) return RESPONSE_TRY_AGAIN;
+  if (xSemaphoreTake(fileLock, FILE_LOCK_TIMEOUT) != pdTRUE) return RESPONSE_TRY_AGAIN;
+
+  char* out = (char*)buffer;
+  size_t length = 0;
+  if (!download.headerSent) {
+    length = strlen(CSV_HEADER);
+    memcpy(out, CSV_HEADER, length);
+    out[length++] = '\n';
+    download.headerSent = true;
+  }
+
+  static LogRecord records[CSV_CHUNK_RECORDS];
+  size_t fit = (maxLength - length) / MAX_ROW_LENGTH;
+  if (fit > CSV_CHUNK_RECORDS) fit = CSV_CHUNK_RECORDS;
+  size_t count = download.query.finished ? 0 :
+                 download.reader.read((uint8_t*)records, fit * sizeof(LogRecord)) / sizeof(LogRecord);
+  xSemaphoreGive(fileLock);
+
+  for (size_t i = 0; i < count; i++) {
+    if (download.query.accept(records[i])) length += formatCsvRow(out + length, records[i], download.microseconds);
+  }
+  // Records read but all outside the window or decimated: not the end yet
+  if (length == 0 && count > 0 && !download.query.finished) return RESPONSE_TRY_AGAIN;
+  return length;  // 0 ends the response
+}
+
+static float floatParam(AsyncWebServerRequest* request, const char* name, float fallback) {
+  return request->hasParam(name) ? atof(request->getParam(name)->value().c_str()) : fallback;
+}
+
+static const RunInfo* findRun(AsyncWebServerRequest* request) {
+  if (!request->hasParam("run")) return latestRun();
+  long runId = atol(request->getParam("run")->value().c_str());
+  for (size_t i = 0; i < runCount(); i++) {
+    if (runAt(i).runId == runId) return &runAt(i);
+  }
+  return nullptr;
+}
+
+static void handleCsv(AsyncWebServerRequest* request) {
+  std::shared_ptr<CsvDownload> download = std::make_shared<CsvDownload>();
+  uint16_t runId = 0;
+  bool opened = false;
+  if (xSemaphoreTake(fileLock, pdMS_TO_TICKS(500)) == pdTRUE) {
+    const RunInfo* run = findRun(request);
+    if (run) {
+      download->microseconds = run->flags & LOG_FLAG_TIMESTAMP_US;
+      download->query.set(floatParam(request, "from", 0), floatParam(request, "to", -1),
+                          (uint32_t)floatParam(request, "every", 1), download->microseconds);
+      opened = download->reader.openAt(*run, download->query.from);
+      runId = run->runId;
+    }
+    xSemaphoreGive(fileLock);
+  }
+  if (!opened) {
+    request->send(404, "text/plain", "No such run\n");
+    return;
+  }
+
+  AsyncWebServerResponse* response = request->beginChunkedResponse("text/csv",
+      [download](uint8_t* buffer, size_t maxLength, size_t index) -> size_t {
+        return fillCsvChunk(*download, buffer, maxLength);
+      });
+  char disposition[48];
+  snprintf(disposition, sizeof(disposition), "attachment; filename=\"run%04u.csv\"", runId);
+  response->addHeader("Content-Disposition", disposition);
+  request->send(response);
+}
+
+static void handleIndex(AsyncWebServerRequest* request) {
+  AsyncResponseStream* page = request->beginResponseStream("text/html");
+  page->printf("<html><body><h3>Temperature station</h3><p>Live samples: ws://&lt;this host&gt;/ws</p><ul>");
+  if (xSemaphoreTake(fileLock, pdMS_TO_TICKS(500)) == pdTRUE) {
+    for (size_t i = runCount(); i-- > 0;) {
+      const RunInfo& run = runAt(i);
+      page->printf("<li><a href=\"/data.csv?run=%u\">Run %u</a>: %lu samples%s</li>",
+                   run.runId, run.runId, (unsigned long)run.sampleCount,
+                   run.state == RUN_OPEN ? " (recording)" : "");
+    }
+    xSemaphoreGive(fileLock);
+  }
+  page->printf("</ul></body></html>");
+  request->send(page);
+}
+
+static void connectWifi(const char* ssid, const char* password) {
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(true);
+  WiFi.begin(ssid, password);
+  if (serverStarted) return;
+
+  server.on("/", HTTP_GET, handleIndex);
+  server.on("/data.csv", HTTP_GET, handleCsv);
+  server.addHandler(&socket);
+  server.begin();
+  serverStarted = true;
+}
+
+void beginNetServer(SemaphoreHandle_t fileMutex) {
+  fileLock = fileMutex;
+  if (!batchLock) batchLock = xSemaphoreCreateMutex();
+  Preferences prefs;
+  char ssid[33] = "";
+  char password[65] = "";
+  if (prefs.begin("station", true)) {
+    if (prefs.isKey("wifi_ssid")) {
+      prefs.getString("wifi_ssid", ssid, sizeof(ssid));
+      prefs.getString("wifi_pass", password, sizeof(password));
+    }
+    prefs.end();
+  }
+  if (ssid[0] != '\0') connectWifi(ssid, password);
+}
+
+void setWifiCredentials(const char* ssid, const char* password) {
+  Preferences prefs;
+  if (prefs.begin("station", false)) {
+    if (ssid[0] != '\0') {
+      prefs.putString("wifi_ssid", ssid);
+      prefs.putString("wifi_pass", password);
+    } else {
+      prefs.remove("wifi_ssid");
+      prefs.remove("wifi_pass");
+    }
+    prefs.end();
+  }
+
+  if (ssid[0] != '\0') {
+    WiFi.disconnect();
+    connectWifi(ssid, password);
+  } else {
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_OFF);
+  }
+}
+
+void pollNetServer() {
+  if (!serverStarted || millis() - lastCleanupMs < WS_CLEANUP_MS) return;
+  lastCleanupMs = millis();
+  socket.cleanupClients();
+}
+
+bool netServerActive() {
+  return serverStarted && WiFi.getMode() != WIFI_OFF;
+}
+
+void printNetStatus(Print& out) {
+  if (!serverStarted) {
+    out.printf("Wi-Fi off ('wifi <ssid> <password>' to enable)\n");
+  } else if (WiFi.status() != WL_CONNECTED) {
+    out.printf("Wi-Fi connecting...\n");
+  } else {
+    out.printf("Wi-Fi connected: http://%s/ (RSSI %d dBm)\n", WiFi.localIP().toString().c_str(), WiFi.RSSI());
+    out.printf("WebSocket clients: %u, batches dropped: %lu\n", (unsigned)socket.count(), (unsigned long)wsDropped);
+  }
+}
+
+// Caller holds batchLock
+static void sendBatch() {
+  TelemetryHeader header = { TELEMETRY_SAMPLES, (uint8_t)wsFlags, wsSequence++, (uint8_t)wsCount };
+  memcpy(wsMessage, &header, sizeof(header));
+  size_t length = sizeof(header) + wsCount * sizeof(LogRecord);
+  wsCount = 0;
+
+  // A client that has not drained its queue misses this batch (sequence shows the gap)
+  if (!socket.availableForWriteAll()) {
+    wsDropped++;
+    return;
+  }
+  socket.binaryAll(wsMessage, length);
+}
+
+void netSample(const LogRecord& record, uint16_t flags) {
+  if (!serverStarted) return;
+  xSemaphoreTake(batchLock, portMAX_DELAY);
+  if (socket.count() == 0) {
+    wsCount = 0;
+    xSemaphoreGive(batchLock);
+    return;
+  }
+  if (wsCount > 0 && flags != wsFlags) sendBatch();
+  if (wsCount == 0) {
+    wsFlags = flags;
+    wsBatchStartMs = millis();
+  }
+  memcpy(wsMessage + sizeof(TelemetryHeader) + wsCount * sizeof(LogRecord), &record, sizeof(LogRecord));
+  if (++wsCount == WS_BATCH_RECORDS) sendBatch();
+  xSemaphoreGive(batchLock);
+}
+
+void flushNetSamples() {
+  if (!serverStarted) return;
+  xSemaphoreTake(batchLock, portMAX_DELAY);
+  if (wsCount > 0 && millis() - wsBatchStartMs >= WS_FLUSH_MS) sendBatch();
+  xSemaphoreGive(batchLock);
+}
+
+#else  // Wi-Fi compiled out
+
+void beginNetServer(SemaphoreHandle_t fileMutex) {}
+void setWifiCredentials(const char* ssid, const char* password) {}
+void pollNetServer() {}
+void printNetStatus(Print& out) { out.printf("Wi-Fi not built in (add -DSTATION_WIFI)\n"); }
+bool netServerActive() { return false; }
+void netSample(const LogRecord& record, uint16_t flags) {}
+void flushNetSamples() {}
+
+#endif
@@ -0,0 +1,879 @@
+#include "run_store.h"
+#include "log_storage.h"
+#include "log_codec.h"
+#include <Preferences.h>
+#include <string.h>
+
+static const char* RUN_INDEX_FILE = "/runs.idx";
+static const char* RUN_INDEX_TEMP = "/runs.idx.tmp";  // Written first, then renamed over the index
+const size_t FREE_SPACE_RESERVE = 2 * SEGMENT_SIZE;  // Kept free before starting a segment
+
+static RunInfo runs[MAX_RUNS];
+static size_t runTotal = 0;
+static bool runOpen = false;       // runs[runTotal - 1] is being written
+static uint32_t bootCount = 0;
+static File segmentFile;
+static File channelFile;           // Open run's auxiliary channels (LOG_FLAG_CHANNELS)
+static File summaryFile;           // Open run's block summaries (LOG_FLAG_SUMMARY)
+static SummaryBuilder summaryBuilder;
+static uint32_t segmentBytes = 0;  // Bytes in the open segment file (including unwritten sector)
+
+// Segment data reaches the filesystem only in whole sectors, so every
+// append costs the same one-sector write regardless of file size. After a
+// commit wrote part of a sector, the next write completes that sector, so
+// writes stay aligned to sector boundaries of the file.
+static uint8_t sectorBuffer[STORAGE_SECTOR_SIZE];
+static size_t sectorFill = 0;
+static uint32_t sectorBase = 0;    // File offset of sectorBuffer[0]
+
+// Journal counters since boot (commits and the open-block bytes they rewrote)
+static uint32_t commitTotal = 0;
+static uint32_t journalTotal = 0;
+
+// Packed runs: records collect in one block, written out when it is full.
+// A commit writes the open block to its slot (at segmentBytes) as it is so
+// far; the block stays open, and later commits and the full block
+// overwrite that same slot, so commits cost no flash space.
+static uint8_t blockBuffer[LOG_BLOCK_SIZE];
+static LogBlockEncoder blockEncoder;
+
+static bool isPacked(const RunInfo& run) {
+  return run.flags & LOG_FLAG_COMPRESSED;
+}
+
+static bool isSealed(const RunInfo& run) {
+  return isPacked(run) && (run.flags & LOG_FLAG_BLOCK_CRC);
+}
+
+// Raw records a segment holds when it is full (all but the last are)
+const uint32_t RAW_SEGMENT_RECORDS = (SEGMENT_SIZE - sizeof(LogFileHeader)) / sizeof(LogRecord);
+
+// Expected timestamp delta between records, in record timestamp units
+static uint32_t timestampStep(const RunInfo& run) {
+  return (run.flags & LOG_FLAG_TIMESTAMP_US) ? run.samplingIntervalUs : run.samplingIntervalUs / 1000;
+}
+
+static void beginBlock(const RunInfo& run) {
+  blockEncoder.begin(blockBuffer, timestampStep(run), isSealed(run) ? LOG_SEALED_PAYLOAD : LOG_BLOCK_PAYLOAD);
+}
+
+void segmentPath(char* path, size_t length, uint16_t runId, uint16_t segment) {
+  snprintf(path, length, "/r%04u_%03u.bin", runId, segment);
+}
+
+void channelPath(char* path, size_t length, uint16_t runId) {
+  snprintf(path, length, "/r%04u_ch.bin", runId);
+}
+
+void summaryPath(char* path, size_t length, uint16_t runId) {
+  snprintf(path, length, "/r%04u_sum.bin", runId);
+}
+
+static uint32_t segmentFileSize(const RunInfo& run, uint16_t segment) {
+  char path[32];
+  segmentPath(path, sizeof(path), run.runId, segment);
+  File file = storageFs().open(path, FILE_READ);
+  if (!file) return 0;
+  uint32_t size = file.size();
+  file.close();
+  return size;
+}
+
+uint32_t runBytes(const RunInfo& run) {
+  if (!isPacked(run)) {
+    return run.segmentCount * sizeof(LogFileHeader) + run.sampleCount * sizeof(LogRecord);
+  }
+  if (run.segmentCount == 0) return 0;
+  // Every segment but the last is full
+  const RunInfo* open = runOpen ? &runs[runTotal - 1] : nullptr;
+  uint32_t last = open == &run ? segmentBytes : segmentFileSize(run, run.segmentCount - 1);
+  return (run.segmentCount - 1) * SEGMENT_SIZE + last;
+}
+
+uint32_t runPayloadBytes(const RunInfo& run) {
+  uint32_t headers = run.segmentCount * (isPacked(run) ? LOG_BLOCK_SIZE : sizeof(LogFileHeader));
+  uint32_t bytes = runBytes(run);
+  return bytes > headers ? bytes - headers : 0;
+}
+
+// Moves `from` over `to` (LittleFS replaces `to`; SPIFFS needs it gone first)
+static bool replaceFile(const char* from, const char* to) {
+  if (storageFs().rename(from, to)) return true;
+  storageFs().remove(to);
+  return storageFs().rename(from, to);
+}
+
+// The new index goes to a temporary file that replaces the old one only
+// once complete, so a reset mid-save leaves one whole index on flash
+static void saveIndex() {
+  File file = storageFs().open(RUN_INDEX_TEMP, FILE_WRITE);
+  if (!file) return;
+  size_t length = runTotal * sizeof(RunInfo);
+  bool ok = file.write((const uint8_t*)runs, length) == length;
+  file.close();
+  if (ok) replaceFile(RUN_INDEX_TEMP, RUN_INDEX_FILE);
+}
+
+// Cuts a file back to its first `length` bytes. The FS API has no
+// truncate, so the kept part is copied and renamed over the original.
+static bool truncateFile(const char* path, size_t length, uint8_t* scratch, size_t scratchSize) {
+  char tempPath[40];
+  snprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
+  File in = storageFs().open(path, FILE_READ);
+  File out = storageFs().open(tempPath, FILE_WRITE);
+  bool ok = in && out;
+  while (ok && length > 0) {
+    size_t chunk = length < scratchSize ? length : scratchSize;
+    ok = in.read(scratch, chunk) == chunk && out.write(scratch, chunk) == chunk;
+    length -= chunk;
+  }
+  if (in) in.close();
+  if (out) out.close();
+  if (!ok) {
+    storageFs().remove(tempPath);
+    return false;
+  }
+  return replaceFile(tempPath, path);
+}
+
+static void deleteRunFiles(const RunInfo& run) {
+  char path[32];
+  for (uint16_t segment = 0; segment < run.segmentCount; segment++) {
+    segmentPath(path, sizeof(path), run.runId, segment);
+    storageFs().remove(path);
+  }
+  if (run.flags & LOG_FLAG_CHANNELS) {
+    channelPath(path, sizeof(path), run.runId);
+    storageFs().remove(path);
+  }
+  if (run.flags & LOG_FLAG_SUMMARY) {
+    summaryPath(path, sizeof(path), run.runId);
+    storageFs().remove(path);
+  }
+}
+
+static void evictOldestRun() {
+  deleteRunFiles(runs[0]);
+  memmove(&runs[0], &runs[1], (runTotal - 1) * sizeof(RunInfo));
+  runTotal--;
+}
+
+static size_t freeBytes() {
+  size_t total = storageTotalBytes();
+  size_t used = storageUsedBytes();
+  return used < total ? total - used : 0;
+}
+
+// Evicts closed runs oldest-first until a new segment fits
+static bool reserveSegmentSpace() {
+  bool evicted = false;
+  while (freeBytes() < FREE_SPACE_RESERVE) {
+    size_t evictable = runOpen ? runTotal - 1 : runTotal;
+    if (evictable == 0) break;
+    evictOldestRun();
+    evicted = true;
+  }
+  if (evicted) saveIndex();
+  return freeBytes() >= FREE_SPACE_RESERVE;
+}
+
+// Writes at sectorBase; a commit may have left the file position past the open block's slot
+static bool writeSector(const uint8_t* data, size_t length) {
+  if (segmentFile.position() != sectorBase && !segmentFile.seek(sectorBase)) return false;
+  return segmentFile.write(data, length) == length;
+}
+
+static bool writeSegmentBytes(const uint8_t* data, size_t length) {
+  while (length > 0) {
+    size_t sectorRoom = STORAGE_SECTOR_SIZE - sectorBase % STORAGE_SECTOR_SIZE;
+    size_t chunk = sectorRoom - sectorFill;
+    if (chunk > length) chunk = length;
+    memcpy(sectorBuffer + sectorFill, data, chunk);
+    sectorFill += chunk;
+    data += chunk;
+    length -= chunk;
+    
+    if (sectorFill == sectorRoom) {
+      if (!writeSector(sectorBuffer, sectorFill)) return false;
+      sectorBase += sectorFill;
+      sectorFill = 0;
+    }
+  }
+  return true;
+}
+
+// Writes out a partially filled sector (only on roll-over, close or commit)
+static bool syncSegment() {
+  bool ok = true;
+  if (sectorFill > 0) {
+    ok = writeSector(sectorBuffer, sectorFill);
+    sectorBase += sectorFill;
+    sectorFill = 0;
+  }
+  segmentFile.flush();
+  return ok;
+}
+
+static bool openNewSegment(RunInfo& run) {
+  if (!reserveSegmentSpace()) return false;
+  
+  char path[32];
+  segmentPath(path, sizeof(path), run.runId, run.segmentCount);
+  segmentFile = storageFs().open(path, FILE_WRITE);
+  if (!segmentFile) return false;
+  
+  LogFileHeader header = makeLogHeader(run.samplingIntervalUs, run.flags);
+  sectorFill = 0;
+  sectorBase = 0;
+  segmentBytes = sizeof(header);
+  run.segmentCount++;
+  if (!isPacked(run)) return writeSegmentBytes((const uint8_t*)&header, sizeof(header));
+  
+  // The header takes a whole block so data blocks stay block aligned
+  memset(blockBuffer, 0, sizeof(blockBuffer));
+  memcpy(blockBuffer, &header, sizeof(header));
+  segmentBytes = LOG_BLOCK_SIZE;
+  bool ok = writeSegmentBytes(blockBuffer, LOG_BLOCK_SIZE);
+  beginBlock(run);
+  return ok;
+}
+
+// Completes the open block with its header (and trailer in sealed runs)
+static void finishBlock(const RunInfo& run) {
+  blockEncoder.finish();
+  if (isSealed(run)) sealLogBlock(blockBuffer, run.sampleCount - blockEncoder.count());
+}
+
+// Writes the current block out and starts the next, rolling to a new
+// segment once this one has no room left for it
+static bool writeBlock(RunInfo& run) {
+  finishBlock(run);
+  if (!writeSegmentBytes(blockBuffer, LOG_BLOCK_SIZE)) return false;
+  segmentBytes += LOG_BLOCK_SIZE;
+  if (segmentBytes + LOG_BLOCK_SIZE > SEGMENT_SIZE) {
+    syncSegment();
+    segmentFile.close();
+    if (!openNewSegment(run)) return false;  // Begins the next block
+    saveIndex();  // Recovery then only has to look past the last indexed segment
+    return true;
+  }
+  beginBlock(run);
+  return true;
+}
+
+// Puts the open block on flash in its slot without closing it; the
+// encoder keeps adding to it (the open block always fits its segment)
+static bool journalBlock(const RunInfo& run) {
+  finishBlock(run);
+  journalTotal += LOG_BLOCK_SIZE;
+  return segmentFile.seek(segmentBytes) && segmentFile.write(blockBuffer, LOG_BLOCK_SIZE) == LOG_BLOCK_SIZE;
+}
+
+static bool appendPacked(RunInfo& run, const LogRecord* records, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (!blockEncoder.add(records[i])) {
+      if (!writeBlock(run)) return false;
+      blockEncoder.add(records[i]);
+    }
+    run.sampleCount++;
+  }
+  return true;
+}
+
+// Records in a packed segment, from its block headers (unsealed runs only)
+static uint32_t countPackedRecords(File& file) {
+  uint32_t records = 0;
+  size_t blocks = file.size() / LOG_BLOCK_SIZE;
+  for (size_t block = 1; block < blocks; block++) {
+    LogBlockHeader header;
+    if (!file.seek(block * LOG_BLOCK_SIZE) ||
+        file.read((uint8_t*)&header, sizeof(header)) != sizeof(header)) break;
+    if (header.payloadBytes <= LOG_BLOCK_PAYLOAD) records += header.recordCount;
+  }
+  return records;
+}
+
+// Sealed segment: walks back from the end to the last block whose CRC
+// holds; its trailer gives the run's record count. False if none does.
+static bool lastSealedCount(File& file, uint32_t& records) {
+  static uint8_t block[LOG_BLOCK_SIZE];
+  for (size_t index = file.size() / LOG_BLOCK_SIZE; index-- > 1;) {
+    LogBlockTrailer trailer;
+    if (!file.seek(index * LOG_BLOCK_SIZE) || file.read(block, LOG_BLOCK_SIZE) != LOG_BLOCK_SIZE) continue;
+    if (!logBlockSealed(block, trailer)) continue;
+    LogBlockHeader header;
+    memcpy(&header, block, sizeof(header));
+    records = trailer.firstRecord + header.recordCount;
+    return true;
+  }
+  return false;
+}
+
+// A sealed block's firstRecord, read from its trailer alone (CRC not checked)
+static bool trailerFirstRecord(File& file, size_t block, uint32_t& first) {
+  LogBlockTrailer trailer;
+  if (!file.seek((block + 1) * LOG_BLOCK_SIZE - sizeof(trailer)) ||
+      file.read((uint8_t*)&trailer, sizeof(trailer)) != sizeof(trailer)) return false;
+  first = trailer.firstRecord;
+  return true;
+}
+
+// Recounts a run that was still open when the station reset. Only the
+// tail is read: segments before the last are full (raw) or their count is
+// carried by the last sealed block; older compressed runs are scanned.
+static void repairRun(RunInfo& run) {
+  char path[32];
+  uint16_t segments = run.segmentCount;
+  for (;;) {
+    segmentPath(path, sizeof(path), run.runId, segments);
+    if (!storageFs().exists(path)) break;
+    segments++;
+  }
+  run.segmentCount = segments;
+  run.sampleCount = 0;
+  run.state = RUN_CLOSED;
+  if (segments == 0) return;
+
+  if (!isPacked(run)) {
+    segmentPath(path, sizeof(path), run.runId, segments - 1);
+    File file = storageFs().open(path, FILE_READ);
+    size_t size = file ? file.size() : 0;
+    if (file) file.close();
+    run.sampleCount = (segments - 1) * RAW_SEGMENT_RECORDS;
+    if (size > sizeof(LogFileHeader)) run.sampleCount += (size - sizeof(LogFileHeader)) / sizeof(LogRecord);
+    return;
+  }
+
+  if (isSealed(run)) {
+    // Newest segment first; earlier ones only if the tail holds no good block
+    for (uint16_t segment = segments; segment-- > 0;) {
+      segmentPath(path, sizeof(path), run.runId, segment);
+      File file = storageFs().open(path, FILE_READ);
+      if (!file) continue;
+      uint32_t records = 0;
+      bool found = lastSealedCount(file, records);
+      file.close();
+      if (found) {
+        run.sampleCount = records;
+        return;
+      }
+    }
+    return;
+  }
+
+  for (uint16_t segment = 0; segment < segments; segment++) {
+    segmentPath(path, sizeof(path), run.runId, segment);
+    File file = storageFs().open(path, FILE_READ);
+    if (!file) continue;
+    run.sampleCount += countPackedRecords(file);
+    file.close();
+  }
+}
+
+bool beginRunStore() {
+  Preferences prefs;
+  if (prefs.begin("station", false)) {
+    bootCount = prefs.getUInt("boots", 0) + 1;
+    prefs.putUInt("boots", bootCount);
+    prefs.end();
+  }
+  
+  runTotal = 0;
+  runOpen = false;
+  // Without the index, a reset hit the remove-then-rename gap of
+  // replaceFile() and the temporary file is the complete new index
+  const char* indexPath = storageFs().exists(RUN_INDEX_FILE) ? RUN_INDEX_FILE : RUN_INDEX_TEMP;
+  if (storageFs().exists(indexPath)) {
+    File file = storageFs().open(indexPath, FILE_READ);
+    if (file) {
+      runTotal = file.read((uint8_t*)runs, sizeof(runs)) / sizeof(RunInfo);
+      file.close();
+    }
+  }
+  
+  bool repaired = false;
+  for (size_t i = 0; i < runTotal; i++) {
+    if (runs[i].state == RUN_OPEN) {
+      repairRun(runs[i]);
+      repaired = true;
+    }
+  }
+  if (repaired) saveIndex();
+  return true;
+}
+
+bool startRun(uint32_t samplingIntervalUs, uint16_t flags, uint8_t setpointCode) {
+  closeRun();
+  if (runTotal == MAX_RUNS) evictOldestRun();
+  
+  uint16_t runId = runTotal > 0 ? runs[runTotal - 1].runId + 1 : 1;
+  if (runId > 9999) runId = 1;
+  
+  RunInfo& run = runs[runTotal];
+  memset(&run, 0, sizeof(run));
+  run.runId = runId;
+  run.bootCount = bootCount;
+  run.startUptimeMs = millis();
+  run.samplingIntervalUs = samplingIntervalUs;
+  run.flags = flags | LOG_FLAG_SUMMARY;
+  run.setpointCode = setpointCode;
+  run.state = RUN_OPEN;
+  runTotal++;
+  runOpen = true;
+  
+  if (!openNewSegment(run)) {
+    runTotal--;
+    runOpen = false;
+    saveIndex();
+    return false;
+  }
+  char path[32];
+  summaryPath(path, sizeof(path), run.runId);
+  summaryFile = storageFs().open(path, FILE_WRITE);
+  summaryBuilder = SummaryBuilder();
+  saveIndex();
+  return true;
+}
+
+// Resumed raw segment: a torn last record (or header) is cut off, since
+// one partial record would shift every record appended after it and
+// break seekRecord(). The sector writer then completes the sector the
+// tail ends in, so later writes are sector aligned again.
+static bool trimRawSegment(const RunInfo& run, const char* path) {
+  size_t size = segmentFile.size();
+  size_t keep = size < sizeof(LogFileHeader) ? 0 : size - (size - sizeof(LogFileHeader)) % sizeof(LogRecord);
+  if (keep == size) return true;
+  segmentFile.close();
+  if (keep == 0) {
+    segmentFile = storageFs().open(path, FILE_WRITE);
+    LogFileHeader header = makeLogHeader(run.samplingIntervalUs, run.flags);
+    return segmentFile && segmentFile.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+  }
+  // Nothing is buffered yet, so the sector buffer serves as copy scratch
+  if (!truncateFile(path, keep, sectorBuffer, sizeof(sectorBuffer))) return false;
+  segmentFile = storageFs().open(path, "r+");
+  return (bool)segmentFile;
+}
+
+bool resumeRun() {
+  if (runOpen) return true;
+  if (runTotal == 0) return false;
+  
+  RunInfo& run = runs[runTotal - 1];
+  runOpen = true;
+  if (run.segmentCount == 0) {
+    if (!openNewSegment(run)) {
+      runOpen = false;
+      return false;
+    }
+  } else {
+    char path[32];
+    segmentPath(path, sizeof(path), run.runId, run.segmentCount - 1);
+    // Read/write: commits rewrite the open block's slot in place
+    segmentFile = storageFs().open(path, "r+");
+    if (!segmentFile || (!isPacked(run) && !trimRawSegment(run, path))) {
+      if (segmentFile) segmentFile.close();
+      runOpen = false;
+      return false;
+    }
+    segmentBytes = segmentFile.size();
+    sectorFill = 0;
+    sectorBase = segmentBytes;
+    if (isPacked(run)) {
+      beginBlock(run);
+      // A torn last block would misalign everything after it
+      if (segmentBytes % LOG_BLOCK_SIZE != 0 || segmentBytes + LOG_BLOCK_SIZE > SEGMENT_SIZE) {
+        segmentFile.close();
+        if (!openNewSegment(run)) {
+          runOpen = false;
+          return false;
+        }
+      }
+    }
+  }
+  if (run.flags & LOG_FLAG_CHANNELS) {
+    char path[32];
+    channelPath(path, sizeof(path), run.runId);
+    channelFile = storageFs().open(path, FILE_APPEND);
+    // Pad a torn last block so the blocks appended next stay aligned
+    size_t size = channelFile ? channelFile.size() : 0;
+    size_t torn = size > sizeof(ChannelFileHeader) ? (size - sizeof(ChannelFileHeader)) % CHANNEL_BLOCK_SIZE : 0;
+    if (torn > 0) {
+      static const uint8_t zeros[CHANNEL_BLOCK_SIZE] = {};
+      channelFile.write(zeros, CHANNEL_BLOCK_SIZE - torn);
+    }
+  }
+  if (run.flags & LOG_FLAG_SUMMARY) {
+    char path[32];
+    summaryPath(path, sizeof(path), run.runId);
+    summaryFile = storageFs().open(path, FILE_APPEND);
+    summaryBuilder = SummaryBuilder();
+    size_t torn = summaryFile ? summaryFile.size() % sizeof(RunSummary) : 0;
+    if (torn > 0) {
+      static const uint8_t zeros[sizeof(RunSummary)] = {};  // Reads as count 0
+      summaryFile.write(zeros, sizeof(RunSummary) - torn);
+    }
+  }
+  run.state = RUN_OPEN;
+  saveIndex();
+  return true;
+}
+
+static void writeSummary() {
+  RunSummary summary = summaryBuilder.finish();
+  if (summaryFile) summaryFile.write((const uint8_t*)&summary, sizeof(summary));
+}
+
+// Adds records [first, first + count) of the run to the block summaries
+static void summarize(uint32_t first, const LogRecord* records, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    summaryBuilder.add(first + i, records[i]);
+    if (summaryBuilder.full()) writeSummary();
+  }
+}
+
+static bool appendRaw(RunInfo& run, const LogRecord* records, size_t count) {
+  while (count > 0) {
+    // Roll over to the next segment (index is rewritten on close; a reset recounts segments)
+    if (segmentBytes + sizeof(LogRecord) > SEGMENT_SIZE) {
+      syncSegment();
+      segmentFile.close();
+      if (!openNewSegment(run)) return false;
+      saveIndex();
+    }
+    
+    size_t room = (SEGMENT_SIZE - segmentBytes) / sizeof(LogRecord);
+    size_t batch = count < room ? count : room;
+    if (!writeSegmentBytes((const uint8_t*)records, batch * sizeof(LogRecord))) return false;
+    segmentBytes += batch * sizeof(LogRecord);
+    run.sampleCount += batch;
+    records += batch;
+    count -= batch;
+  }
+  return true;
+}
+
+bool appendRecords(const LogRecord* records, size_t count) {
+  if (!runOpen) return false;
+  RunInfo& run = runs[runTotal - 1];
+  uint32_t first = run.sampleCount;
+  bool ok = isPacked(run) ? appendPacked(run, records, count) : appendRaw(run, records, count);
+  summarize(first, records, run.sampleCount - first);
+  return ok;
+}
+
+bool commitRun() {
+  if (!runOpen) return true;
+  RunInfo& run = runs[runTotal - 1];
+  // Full blocks first: they end where the open block's slot begins
+  bool ok = syncSegment();
+  if (isPacked(run) && blockEncoder.count() > 0) {
+    if (!journalBlock(run)) ok = false;
+    segmentFile.flush();
+  }
+  if (channelFile) channelFile.flush();
+  if (summaryFile) summaryFile.flush();
+  commitTotal++;
+  return ok;
+}
+
+uint32_t commitCount() { return commitTotal; }
+uint32_t commitJournalBytes() { return journalTotal; }
+
+void closeRun() {
+  if (!runOpen) return;
+  RunInfo& run = runs[runTotal - 1];
+  if (isPacked(run) && blockEncoder.count() > 0) {
+    // Final content of the open block, over its journaled copy
+    finishBlock(run);
+    writeSegmentBytes(blockBuffer, LOG_BLOCK_SIZE);
+    segmentBytes += LOG_BLOCK_SIZE;
+  }
+  syncSegment();
+  segmentFile.close();
+  if (channelFile) channelFile.close();
+  if (!summaryBuilder.empty()) writeSummary();
+  if (summaryFile) summaryFile.close();
+  run.state = RUN_CLOSED;
+  runOpen = false;
+  saveIndex();
+}
+
+void clearAllRuns() {
+  closeRun();
+  for (size_t i = 0; i < runTotal; i++) {
+    deleteRunFiles(runs[i]);
+  }
+  runTotal = 0;
+  storageFs().remove(RUN_INDEX_FILE);
+  storageFs().remove(RUN_INDEX_TEMP);
+}
+
+bool startChannels(const ChannelFileHeader& header) {
+  if (!runOpen) return false;
+  const RunInfo& run = runs[runTotal - 1];
+  if (!(run.flags & LOG_FLAG_CHANNELS)) return false;
+  char path[32];
+  channelPath(path, sizeof(path), run.runId);
+  channelFile = storageFs().open(path, FILE_WRITE);
+  if (!channelFile) return false;
+  return channelFile.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+}
+
+bool appendChannelBlock(const uint8_t* block) {
+  if (!runOpen || !channelFile) return false;
+  return channelFile.write(block, CHANNEL_BLOCK_SIZE) == CHANNEL_BLOCK_SIZE;
+}
+
+bool openChannelFile(const RunInfo& run, File& file, ChannelFileHeader& header) {
+  if (!(run.flags & LOG_FLAG_CHANNELS)) return false;
+  char path[32];
+  channelPath(path, sizeof(path), run.runId);
+  file = storageFs().open(path, FILE_READ);
+  if (!file) return false;
+  if (file.read((uint8_t*)&header, sizeof(header)) != sizeof(header) || header.magic != CHANNEL_MAGIC) {
+    file.close();
+    return false;
+  }
+  return true;
+}
+
+bool openSummaryFile(const RunInfo& run, File& file) {
+  if (!(run.flags & LOG_FLAG_SUMMARY)) return false;
+  char path[32];
+  summaryPath(path, sizeof(path), run.runId);
+  file = storageFs().open(path, FILE_READ);
+  return (bool)file;
+}
+
+uint32_t recordAtTime(const RunInfo& run, uint32_t timestamp) {
+  File file;
+  if (!openSummaryFile(run, file)) return 0;
+  
+  // Last summary starting at or before `timestamp`; padding (count 0)
+  // carries no timestamp and is stepped over
+  size_t low = 0;
+  size_t high = file.size() / sizeof(RunSummary);
+  uint32_t found = 0;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    RunSummary summary = {};
+    size_t probe = mid;
+    while (probe < high) {
+      if (!file.seek(probe * sizeof(RunSummary)) ||
+          file.read((uint8_t*)&summary, sizeof(summary)) != sizeof(summary)) break;
+      if (summary.count > 0) break;
+      probe++;
+    }
+    if (probe >= high || summary.count == 0) {
+      high = mid;
+    } else if (summary.firstTimestamp <= timestamp) {
+      found = summary.firstRecord;
+      low = probe + 1;
+    } else {
+      high = mid;
+    }
+  }
+  file.close();
+  return found;
+}
+
+bool runIsOpen() { return runOpen; }
+size_t runCount() { return runTotal; }
+const RunInfo& runAt(size_t i) { return runs[i]; }
+const RunInfo* latestRun() { return runTotal > 0 ? &runs[runTotal - 1] : nullptr; }
+
+// ==================== RUN READER ====================
+
+bool RunReader::open(const RunInfo& run, bool decode) {
+  close();
+  info = run;
+  decodeBlocks = decode && isPacked(run);
+  skipRecords = 0;
+  active = openSegment(0);
+  return active;
+}
+
+bool RunReader::openAt(const RunInfo& run, uint32_t timestamp) {
+  if (!open(run)) return false;
+  uint32_t record = recordAtTime(run, timestamp);
+  if (record > 0) seekRecord(record);
+  return true;
+}
+
+bool RunReader::openSegment(uint16_t index) {
+  if (index >= info.segmentCount) return false;
+  
+  char path[32];
+  segmentPath(path, sizeof(path), info.runId, index);
+  file = storageFs().open(path, FILE_READ);
+  if (!file) return false;
+  
+  LogFileHeader header;
+  if (file.read((uint8_t*)&header, sizeof(header)) != sizeof(header) || !isValidLogHeader(header)) {
+    file.close();
+    return false;
+  }
+  if (index == 0) fileHeader = header;
+  segment = index;
+  
+  if (header.flags & LOG_FLAG_COMPRESSED) {
+    // Whole blocks after the header block; a torn last block is ignored
+    size_t blocks = file.size() / LOG_BLOCK_SIZE;
+    segmentRemaining = blocks > 1 ? (blocks - 1) * LOG_BLOCK_SIZE : 0;
+    blockPending = false;
+    return file.seek(LOG_BLOCK_SIZE);
+  }
+  
+  // Ignore a torn record at the end of a segment
+  size_t payload = file.size() - sizeof(LogFileHeader);
+  segmentRemaining = payload - payload % sizeof(LogRecord);
+  return true;
+}
+
+size_t RunReader::readDecoded(uint8_t* buffer, size_t length) {
+  size_t total = 0;
+  while (active && total + sizeof(LogRecord) <= length) {
+    LogRecord record;
+    if (blockPending && decoder.next(record)) {
+      if (skipRecords > 0) {
+        skipRecords--;
+        continue;
+      }
+      memcpy(buffer + total, &record, sizeof(record));
+      total += sizeof(record);
+      continue;
+    }
+    // Next block, skipping any that fail to decode
+    blockPending = false;
+    if (segmentRemaining >= LOG_BLOCK_SIZE && file.read(block, LOG_BLOCK_SIZE) == LOG_BLOCK_SIZE) {
+      segmentRemaining -= LOG_BLOCK_SIZE;
+      LogBlockTrailer trailer;
+      blockPending = decoder.begin(block) && (!(info.flags & LOG_FLAG_BLOCK_CRC) || logBlockSealed(block, trailer));
+    } else {
+      file.close();
+      active = openSegment(segment + 1);
+    }
+  }
+  return total;
+}
+
+size_t RunReader::read(uint8_t* buffer, size_t length) {
+  if (decodeBlocks) return readDecoded(buffer, length);
+  size_t total = 0;
+  while (active && total < length) {
+    size_t wanted = length - total;
+    if (wanted > segmentRemaining) wanted = segmentRemaining;
+    size_t got = wanted > 0 ? file.read(buffer + total, wanted) : 0;
+    total += got;
+    segmentRemaining -= got;
+    if (got == 0) {
+      file.close();
+      active = openSegment(segment + 1);
+    }
+  }
+  return total;
+}
+
+// Block of a packed run holding `record`, and the run index of its first record
+bool RunReader::findBlock(uint32_t record, uint16_t& foundSegment, size_t& foundBlock, uint32_t& first) {
+  char path[32];
+  if (info.flags & LOG_FLAG_BLOCK_CRC) {
+    // Trailer firstRecord grows with the block position: bisect segments by
+    // their first block, then blocks within the segment
+    uint16_t low = 0;
+    uint16_t high = info.segmentCount;
+    while (high - low > 1) {
+      uint16_t mid = low + (high - low) / 2;
+      segmentPath(path, sizeof(path), info.runId, mid);
+      File f = storageFs().open(path, FILE_READ);
+      uint32_t index = 0;
+      bool ok = f && trailerFirstRecord(f, 1, index);
+      if (f) f.close();
+      if (ok && index <= record) low = mid; else high = mid;
+    }
+    segmentPath(path, sizeof(path), info.runId, low);
+    File f = storageFs().open(path, FILE_READ);
+    if (!f) return false;
+    size_t blockLow = 1;
+    size_t blockHigh = f.size() / LOG_BLOCK_SIZE;
+    first = 0;
+    while (blockHigh - blockLow > 1) {
+      size_t mid = blockLow + (blockHigh - blockLow) / 2;
+      uint32_t index = 0;
+      if (trailerFirstRecord(f, mid, index) && index <= record) blockLow = mid; else blockHigh = mid;
+    }
+    LogBlockHeader header;
+    bool ok = blockLow < f.size() / LOG_BLOCK_SIZE && trailerFirstRecord(f, blockLow, first) && first <= record &&
+              f.seek(blockLow * LOG_BLOCK_SIZE) && f.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+              record - first < header.recordCount;
+    f.close();
+    foundSegment = low;
+    foundBlock = blockLow;
+    return ok;
+  }
+  
+  // Unsealed: add up block record counts from the start
+  uint32_t seen = 0;
+  for (uint16_t segment = 0; segment < info.segmentCount; segment++) {
+    segmentPath(path, sizeof(path), info.runId, segment);
+    File f = storageFs().open(path, FILE_READ);
+    if (!f) continue;
+    size_t blocks = f.size() / LOG_BLOCK_SIZE;
+    for (size_t block = 1; block < blocks; block++) {
+      LogBlockHeader header;
+      if (!f.seek(block * LOG_BLOCK_SIZE) ||
+          f.read((uint8_t*)&header, sizeof(header)) != sizeof(header)) break;
+      if (header.payloadBytes > LOG_BLOCK_PAYLOAD) continue;
+      if (record < seen + header.recordCount) {
+        f.close();
+        foundSegment = segment;
+        foundBlock = block;
+        first = seen;
+        return true;
+      }
+      seen += header.recordCount;
+    }
+    f.close();
+  }
+  return false;
+}
+
+bool RunReader::seekRecord(uint32_t record) {
+  if (active) file.close();
+  active = false;
+  blockPending = false;
+  skipRecords = 0;
+  
+  if (!isPacked(info)) {
+    uint16_t index = record / RAW_SEGMENT_RECORDS;
+    if (!openSegment(index)) return false;
+    size_t offset = (record % RAW_SEGMENT_RECORDS) * sizeof(LogRecord);
+    if (offset >= segmentRemaining || !file.seek(sizeof(LogFileHeader) + offset)) {
+      file.close();
+      return false;
+    }
+    segmentRemaining -= offset;
+    active = true;
+    return true;
+  }
+  
+  uint16_t index;
+  size_t block;
+  uint32_t first;
+  if (!decodeBlocks || !findBlock(record, index, block, first) || !openSegment(index)) return false;
+  size_t offset = (block - 1) * LOG_BLOCK_SIZE;
+  if (offset >= segmentRemaining || !file.seek(block * LOG_BLOCK_SIZE)) {
+    file.close();
+    return false;
+  }
+  segmentRemaining -= offset;
+  skipRecords = record - first;
+  active = true;
+  return true;
+}
+
+void RunReader::close() {
+  if (active) file.close();
+  active = false;
+}
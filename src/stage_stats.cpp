@@ -0,0 +1,88 @@
+#include "stage_stats.h"
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+
+static const char* const STAGE_NAMES[STAGE_COUNT] = {
+  "sample wake", "sample jitter", "adc read", "control period",
+  "storage pass", "flash append", "serial output", "command",
+};
+
+static LatencyHistogram histograms[STAGE_COUNT];
+static volatile uint32_t missedCount = 0;
+static uint32_t cyclesPerUs = 240;
+static size_t heapAtBoot = 0;       // 0 until beginHeapWatch()
+static size_t heapLowestAtBoot = 0; // Allocator low mark then; a lower one came after
+
+void stageEnd(Stage stage, uint32_t start) {
+  histograms[stage].record((esp_cpu_get_ccount() - start) / cyclesPerUs);
+}
+
+void stageRecordUs(Stage stage, uint32_t us) {
+  histograms[stage].record(us);
+}
+
+void noteMissedDeadline() {
+  missedCount = missedCount + 1;
+}
+
+uint32_t missedDeadlines() { return missedCount; }
+
+void beginStageStats() {
+  cyclesPerUs = getCpuFrequencyMhz();
+  if (cyclesPerUs == 0) cyclesPerUs = 1;
+  resetStageStats();
+}
+
+void beginHeapWatch() {
+  heapAtBoot = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  heapLowestAtBoot = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+}
+
+void resetStageStats() {
+  for (size_t i = 0; i < STAGE_COUNT; i++) histograms[i].reset();
+  missedCount = 0;
+}
+
+void printStageStats(Print& out, uint32_t samplingIntervalMs) {
+  out.printf("%-15s %9s %8s %8s %8s %9s  [us]\n", "stage", "count", "mean", "p50<", "p99<", "max");
+  for (size_t i = 0; i < STAGE_COUNT; i++) {
+    const LatencyHistogram& h = histograms[i];
+    out.printf("%-15s %9lu %8lu %8lu %8lu %9lu\n", STAGE_NAMES[i], (unsigned long)h.count(),
+               (unsigned long)h.mean(), (unsigned long)h.percentile(50), (unsigned long)h.percentile(99),
+               (unsigned long)h.max());
+  }
+  out.printf("Missed sampling deadlines (%lu ms): %lu\n", (unsigned long)samplingIntervalMs,
+             (unsigned long)missedCount);
+  size_t free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  size_t lowest = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+  out.printf("Heap free: %lu bytes (after boot %lu, lowest ever %lu, largest block %lu)\n",
+             (unsigned long)free, (unsigned long)heapAtBoot, (unsigned long)lowest,
+             (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+  if (heapAtBoot > 0) {
+    long held = (long)heapAtBoot - (long)free;
+    out.printf("Heap held since boot: %ld bytes now", held);
+    if (lowest < heapLowestAtBoot) {
+      out.printf(", %lu at the lowest point\n", (unsigned long)(heapAtBoot - lowest));
+    } else {
+      out.printf(", no new low\n");
+    }
+  }
+
+  // Raw buckets, non-empty only: "<limit:count"
+  out.printf("Histograms (<us:count):\n");
+  for (size_t i = 0; i < STAGE_COUNT; i++) {
+    const LatencyHistogram& h = histograms[i];
+    if (h.count() == 0) continue;
+    out.printf("  %-15s", STAGE_NAMES[i]);
+    for (size_t b = 0; b < LATENCY_BUCKETS; b++) {
+      if (h.bucketCount(b) == 0) continue;
+      if (b == LATENCY_BUCKETS - 1) {
+        out.printf(" >=%lu:%lu", (unsigned long)LatencyHistogram::bucketLimit(b - 1),
+                   (unsigned long)h.bucketCount(b));
+      } else {
+        out.printf(" <%lu:%lu", (unsigned long)LatencyHistogram::bucketLimit(b), (unsigned long)h.bucketCount(b));
+      }
+    }
+    out.printf("\n");
+  }
+}
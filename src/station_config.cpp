@@ -0,0 +1,155 @@
+#include "station_config.h"
+#include <Preferences.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum ParamType { PARAM_U32, PARAM_U16, PARAM_U8, PARAM_FLOAT };
+
+struct ConfigParam {
+  const char* name;      // As typed after `set`
+  const char* key;       // NVS key (15 chars max)
+  ParamType type;
+  size_t offset;         // Field in StationConfig
+  float minValue;
+  float maxValue;
+  bool lockedDuringTest; // Would change a run that is already being recorded
+  const char* unit;
+};
+
+static const ConfigParam PARAMS[] = {
+  { "rate",   "rate",   PARAM_U32,   offsetof(StationConfig, samplingIntervalMs),      1, 60000,   true,  "ms" },
+  { "wait",   "wait",   PARAM_U32,   offsetof(StationConfig, initialWaitMs),           0, 3600000, true,  "ms" },
+  { "base",   "base",   PARAM_FLOAT, offsetof(StationConfig, baseVoltage),             0, 3.3f,    true,  "V" },
+  { "step",   "step",   PARAM_FLOAT, offsetof(StationConfig, stepVoltage),             0, 3.3f,    true,  "V" },
+  { "kp",     "kp",     PARAM_FLOAT, offsetof(StationConfig, kp),                      0, 1000,    false, "V/V" },
+  { "ki",     "ki",     PARAM_FLOAT, offsetof(StationConfig, ki),                      0, 1000,    false, "1/s" },
+  { "kd",     "kd",     PARAM_FLOAT, offsetof(StationConfig, kd),                      0, 1000,    false, "s" },
+  { "os",     "os",     PARAM_U8,    offsetof(StationConfig, oversampleShift),         0, 6,       false, "shift" },
+  { "stream", "stream", PARAM_U16,   offsetof(StationConfig, streamDecimation),        0, 10000,   false, "every Nth" },
+  { "compress", "compress", PARAM_U8, offsetof(StationConfig, compressLog),           0, 1,       true,  "0/1" },
+  { "commit", "commit", PARAM_U32,   offsetof(StationConfig, commitIntervalMs),        0, 600000,  false, "ms" },
+  { "aux1",   "aux1",   PARAM_U16,   offsetof(StationConfig, auxDecimation[0]),        0, 1000,    true,  "ticks, 0 = off" },
+  { "aux2",   "aux2",   PARAM_U16,   offsetof(StationConfig, auxDecimation[1]),        0, 1000,    true,  "ticks, 0 = off" },
+  { "aux3",   "aux3",   PARAM_U16,   offsetof(StationConfig, auxDecimation[2]),        0, 1000,    true,  "ticks, 0 = off" },
+  { "aux4",   "aux4",   PARAM_U16,   offsetof(StationConfig, auxDecimation[3]),        0, 1000,    true,  "ticks, 0 = off" },
+  { "out2",   "out2",   PARAM_FLOAT, offsetof(StationConfig, auxDacVoltage),           0, 3.3f,    false, "V" },
+  { "pre",    "pre",    PARAM_U32,   offsetof(StationConfig, preTriggerMs),            0, 600000,  true,  "ms" },
+  { "post",   "post",   PARAM_U32,   offsetof(StationConfig, postTriggerMs),           0, 3600000, true,  "ms" },
+  { "slope",  "slope",  PARAM_FLOAT, offsetof(StationConfig, triggerSlopeMvPerS),      0, 100000,  true,  "mV/s, 0 = off" },
+  { "trigsp", "trigsp", PARAM_U8,    offsetof(StationConfig, triggerOnSetpoint),       0, 1,       true,  "0/1" },
+  { "sleep",  "sleep",  PARAM_U8,    offsetof(StationConfig, lowPower),                0, 1,       false, "0/1" },
+  { "keys",   "keys",   PARAM_U8,    offsetof(StationConfig, singleKeys),              0, 1,       false, "0/1" },
+};
+static const size_t PARAM_COUNT = sizeof(PARAMS) / sizeof(PARAMS[0]);
+
+StationConfig config;
+static StationConfig defaultConfig;
+
+static const ConfigParam* findParam(const char* name) {
+  for (size_t i = 0; i < PARAM_COUNT; i++) {
+    if (strcasecmp(PARAMS[i].name, name) == 0) return &PARAMS[i];
+  }
+  return nullptr;
+}
+
+static void* field(StationConfig& target, const ConfigParam& param) {
+  return (uint8_t*)&target + param.offset;
+}
+
+// Parses the whole of `text` as a number within the parameter's range
+static bool parseValue(const ConfigParam& param, const char* text, StationConfig& target) {
+  char* end;
+  float value = strtof(text, &end);
+  if (end == text || *end != '\0' || value < param.minValue || value > param.maxValue) return false;
+  if (param.type != PARAM_FLOAT && value != (float)(uint32_t)value) return false;  // Integers only
+
+  switch (param.type) {
+    case PARAM_U32:   *(uint32_t*)field(target, param) = (uint32_t)value; break;
+    case PARAM_U16:   *(uint16_t*)field(target, param) = (uint16_t)value; break;
+    case PARAM_U8:    *(uint8_t*)field(target, param) = (uint8_t)value; break;
+    case PARAM_FLOAT: *(float*)field(target, param) = value; break;
+  }
+  return true;
+}
+
+static void saveParam(Preferences& prefs, const ConfigParam& param) {
+  switch (param.type) {
+    case PARAM_U32:   prefs.putUInt(param.key, *(uint32_t*)field(config, param)); break;
+    case PARAM_U16:   prefs.putUShort(param.key, *(uint16_t*)field(config, param)); break;
+    case PARAM_U8:    prefs.putUChar(param.key, *(uint8_t*)field(config, param)); break;
+    case PARAM_FLOAT: prefs.putFloat(param.key, *(float*)field(config, param)); break;
+  }
+}
+
+void beginConfig(const StationConfig& defaults) {
+  defaultConfig = defaults;
+  config = defaults;
+  Preferences prefs;
+  if (!prefs.begin("station", true)) return;
+  for (size_t i = 0; i < PARAM_COUNT; i++) {
+    const ConfigParam& param = PARAMS[i];
+    if (!prefs.isKey(param.key)) continue;
+    switch (param.type) {
+      case PARAM_U32:   *(uint32_t*)field(config, param) = prefs.getUInt(param.key); break;
+      case PARAM_U16:   *(uint16_t*)field(config, param) = prefs.getUShort(param.key); break;
+      case PARAM_U8:    *(uint8_t*)field(config, param) = prefs.getUChar(param.key); break;
+      case PARAM_FLOAT: *(float*)field(config, param) = prefs.getFloat(param.key); break;
+    }
+  }
+  prefs.end();
+}
+
+ConfigStatus setConfigValues(const char* const* names, const char* const* values, size_t count,
+                             bool testRunning, const char** failed) {
+  StationConfig candidate = config;
+  const ConfigParam* changed[PARAM_COUNT];
+  size_t changedCount = 0;
+  for (size_t i = 0; i < count; i++) {
+    *failed = names[i];
+    const ConfigParam* param = findParam(names[i]);
+    if (!param) return CONFIG_UNKNOWN;
+    if (param->lockedDuringTest && testRunning) return CONFIG_LOCKED;
+    if (!parseValue(*param, values[i], candidate)) return CONFIG_INVALID;
+    bool listed = false;
+    for (size_t j = 0; j < changedCount; j++) listed |= changed[j] == param;
+    if (!listed) changed[changedCount++] = param;
+  }
+  *failed = nullptr;
+
+  config = candidate;
+  Preferences prefs;
+  if (prefs.begin("station", false)) {
+    for (size_t i = 0; i < changedCount; i++) saveParam(prefs, *changed[i]);
+    prefs.end();
+  }
+  return CONFIG_OK;
+}
+
+void resetConfig() {
+  config = defaultConfig;
+  Preferences prefs;
+  if (prefs.begin("station", false)) {
+    for (size_t i = 0; i < PARAM_COUNT; i++) prefs.remove(PARAMS[i].key);
+    prefs.end();
+  }
+}
+
+void printConfig(Print& out) {
+  for (size_t i = 0; i < PARAM_COUNT; i++) {
+    const ConfigParam& param = PARAMS[i];
+    switch (param.type) {
+      case PARAM_U32:
+        out.printf("  %-6s %10lu %s\n", param.name, (unsigned long)*(uint32_t*)field(config, param), param.unit);
+        break;
+      case PARAM_U16:
+        out.printf("  %-6s %10u %s\n", param.name, *(uint16_t*)field(config, param), param.unit);
+        break;
+      case PARAM_U8:
+        out.printf("  %-6s %10u %s\n", param.name, *(uint8_t*)field(config, param), param.unit);
+        break;
+      case PARAM_FLOAT:
+        out.printf("  %-6s %10.3f %s\n", param.name, *(float*)field(config, param), param.unit);
+        break;
+    }
+  }
+}
@@ -0,0 +1,81 @@
+#include "telemetry.h"
+#include <Arduino.h>
+#include "telemetry_format.h"
+#include "cobs.h"
+#include "crc32.h"
+
+const size_t PACKET_BYTES = sizeof(TelemetryHeader) + TELEMETRY_BATCH_RECORDS * sizeof(LogRecord) + sizeof(uint32_t);
+
+static uint16_t decimation = 0;
+static volatile uint16_t pendingDecimation = 0;  // Set by any task, taken up by the one streaming
+static uint16_t skipped = 0;
+static uint16_t sequence = 0;
+static uint16_t batchFlags = 0;
+static LogRecord batch[TELEMETRY_BATCH_RECORDS];
+static size_t batchCount = 0;
+static uint32_t packetsSent = 0;
+static uint32_t packetsDropped = 0;
+
+void setTelemetryDecimation(uint16_t n) {
+  pendingDecimation = n;
+}
+
+bool telemetryEnabled() {
+  uint16_t n = pendingDecimation;
+  if (n != decimation) {
+    decimation = n;
+    skipped = 0;
+    sequence = 0;
+    batchCount = 0;
+    packetsSent = 0;
+    packetsDropped = 0;
+  }
+  return decimation > 0;
+}
+
+void telemetrySample(const LogRecord& record, uint16_t flags) {
+  if (decimation == 0) return;
+  if (++skipped < decimation) return;
+  skipped = 0;
+
+  if (batchCount > 0 && flags != batchFlags) flushTelemetry();
+  batchFlags = flags;
+  batch[batchCount++] = record;
+  if (batchCount == TELEMETRY_BATCH_RECORDS) flushTelemetry();
+}
+
+void flushTelemetry() {
+  if (batchCount == 0) return;
+
+  static uint8_t packet[PACKET_BYTES];
+  static uint8_t frame[cobsMaxEncodedLength(PACKET_BYTES) + 1];
+  TelemetryHeader header = { TELEMETRY_SAMPLES, (uint8_t)batchFlags, sequence++, (uint8_t)batchCount };
+  size_t length = 0;
+  memcpy(packet, &header, sizeof(header));
+  length += sizeof(header);
+  memcpy(packet + length, batch, batchCount * sizeof(LogRecord));
+  length += batchCount * sizeof(LogRecord);
+  uint32_t crc = crc32Update(0, packet, length);
+  memcpy(packet + length, &crc, sizeof(crc));
+  length += sizeof(crc);
+  batchCount = 0;
+
+  size_t frameLength = cobsEncode(packet, length, frame);
+  frame[frameLength++] = 0x00;
+
+  // Never block: the whole frame must fit in the TX ring or it is dropped
+  if ((size_t)Serial.availableForWrite() < frameLength) {
+    packetsDropped++;
+    return;
+  }
+  Serial.write(frame, frameLength);
+  packetsSent++;
+}
+
+uint32_t telemetryPacketsSent() {
+  return packetsSent;
+}
+
+uint32_t telemetryPacketsDropped() {
+  return packetsDropped;
+}
@@ -1,8 +1,13 @@
 %% Load and Plot Step Response Data
+% Manual single-run analysis. For streaming ingest and identification of
+% several stations at once see tools/station_ingest.py
 data = readtable('./data/data.csv');
 
 time = data.timestamp_ms / 1000;  % Convert to seconds
-voltage = (data.sensor_v + 0.4) .*(1);
+% sensor_v is calibrated on the device ('k' command); the old +0.4 V
+% fudge is only needed for logs recorded without calibration
+adc_offset = 0.0;
+voltage = (data.sensor_v + adc_offset) .*(1);
 
 % Normalize time to start from 0
 time = time - time(1);
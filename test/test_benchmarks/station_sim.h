@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+#include "code_scaling.h"
+#include "log_format.h"
+
+// ==================== SIMULATED STATION (env:native) ====================
+// Host stand-ins for the hardware the firmware pipeline touches:
+//   - SimulatedPlant: DAC -> first-order-plus-dead-time thermal response
+//     -> 12-bit ADC code with a few LSB of noise
+//   - MemoryFlash: sector-buffered byte sink like run_store's segment writes
+//   - adcCalTable: ideal linear calibration (normally built from eFuse)
+
+uint16_t adcCalTable[ADC_MAX_CODE + 1];
+
+inline void buildLinearCalibration() {
+  for (uint32_t code = 0; code <= ADC_MAX_CODE; code++) {
+    adcCalTable[code] = (uint16_t)adcCodeToDmv(code);
+  }
+}
+
+class SimulatedPlant {
+public:
+  SimulatedPlant(float gain, float timeConstantS, float deadTimeS, float sampleS)
+      : gain(gain), alpha(sampleS / (timeConstantS + sampleS)) {
+    delaySamples = (size_t)(deadTimeS / sampleS + 0.5f);
+    history.assign(delaySamples + 1, 0);
+  }
+
+  void writeDac(uint8_t code) { dacCode = code; }
+
+  // One oversampled reading per call, one sample period later than the last
+  uint16_t readAdc() {
+    history[position] = dacCode;
+    position = (position + 1) % history.size();
+    float input = dacCodeToDmv(history[position]) * gain;  // Delayed by the dead time
+    outputDmv += (input - outputDmv) * alpha;
+    int32_t code = (int32_t)dmvToAdcCode((uint32_t)(outputDmv + 0.5f)) + noise();
+    return code < 0 ? 0 : code > (int32_t)ADC_MAX_CODE ? ADC_MAX_CODE : (uint16_t)code;
+  }
+
+private:
+  // Roughly Gaussian, +-3 LSB (sum of uniform draws from an LCG)
+  int32_t noise() {
+    int32_t sum = 0;
+    for (int i = 0; i < 3; i++) {
+      seed = seed * 1664525u + 1013904223u;
+      sum += (int32_t)(seed >> 30);  // 0..3
+    }
+    return sum - 4;
+  }
+
+  float gain;
+  float alpha;
+  float outputDmv = 0;
+  uint8_t dacCode = 0;
+  size_t delaySamples;
+  size_t position = 0;
+  std::vector<uint8_t> history;
+  uint32_t seed = 12345;
+};
+
+// Collects bytes the way run_store writes segments: whole sectors only
+class MemoryFlash {
+public:
+  static const size_t SECTOR_SIZE = 4096;
+
+  void write(const uint8_t* data, size_t length) {
+    bytes.insert(bytes.end(), data, data + length);
+    fill += length;
+    sectorWrites += fill / SECTOR_SIZE;
+    fill %= SECTOR_SIZE;
+  }
+
+  size_t size() const { return bytes.size(); }
+  const uint8_t* data() const { return bytes.data(); }
+
+  std::vector<uint8_t> bytes;
+  size_t fill = 0;
+  size_t sectorWrites = 0;
+};
+
+// Records of one simulated step test: baseline, step, settle
+inline std::vector<LogRecord> simulateStepTest(size_t samples, uint32_t intervalMs, uint8_t stepCode) {
+  SimulatedPlant plant(1.0f, 20.0f, 2.0f, intervalMs / 1000.0f);
+  std::vector<LogRecord> records;
+  records.reserve(samples);
+  uint8_t dac = 0;
+  for (size_t i = 0; i < samples; i++) {
+    if (i == samples / 10) dac = stepCode;
+    plant.writeDac(dac);
+    LogRecord record = { (uint32_t)(i * intervalMs), plant.readAdc(), dac };
+    records.push_back(record);
+  }
+  return records;
+}
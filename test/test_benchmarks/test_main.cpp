@@ -0,0 +1,354 @@
+// Host benchmarks of the logging/sampling pipeline: `pio test -e native`
+// Prints samples/sec, per-sample latency percentiles and bytes per
+// sample for each storage format, then checks the formats round-trip.
+// Set -DBENCH_MAX_P99_NS=<ns> in env:native to fail on a slow stage.
+
+#include <unity.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "station_sim.h"
+#include "log_format.h"
+#include "log_codec.h"
+#include "csv_format.h"
+#include "cobs.h"
+#include "crc32.h"
+#include "sample_ring.h"
+#include "pid_controller.h"
+#include "step_estimator.h"
+#include "telemetry_format.h"
+
+const size_t BENCH_SAMPLES = 200000;
+const uint32_t BENCH_INTERVAL_MS = 10;
+const uint8_t BENCH_STEP_CODE = 116;      // About 1.5 V
+const size_t SEGMENT_BYTES = 64 * 1024;  // run_store.h SEGMENT_SIZE
+const uint32_t DEFAULT_INTERVAL_MS = 500;  // main.cpp DEFAULT_SAMPLING_INTERVAL_MS
+const uint32_t DEFAULT_COMMIT_MS = 2000;   // main.cpp DEFAULT_COMMIT_INTERVAL_MS
+
+using BenchClock = std::chrono::steady_clock;
+
+static std::vector<LogRecord> records;
+
+struct BenchResult {
+  double samplesPerSecond;
+  double p50Ns;
+  double p99Ns;
+  double maxNs;
+};
+
+// Times `stage(i)` once per sample; latencies include one clock read
+template <typename Stage>
+static BenchResult measure(size_t samples, Stage stage) {
+  std::vector<double> latencies(samples);
+  BenchClock::time_point begin = BenchClock::now();
+  for (size_t i = 0; i < samples; i++) {
+    BenchClock::time_point start = BenchClock::now();
+    stage(i);
+    latencies[i] = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count();
+  }
+  double totalS = std::chrono::duration<double>(BenchClock::now() - begin).count();
+  std::sort(latencies.begin(), latencies.end());
+  BenchResult result;
+  result.samplesPerSecond = samples / totalS;
+  result.p50Ns = latencies[samples / 2];
+  result.p99Ns = latencies[samples * 99 / 100];
+  result.maxNs = latencies[samples - 1];
+  return result;
+}
+
+static void report(const char* stage, const BenchResult& result, double bytesPerSample) {
+  char bytes[16] = "-";
+  if (bytesPerSample > 0) snprintf(bytes, sizeof(bytes), "%.2f", bytesPerSample);
+  printf("  %-28s %12.0f %9.0f %9.0f %10.0f %9s\n", stage, result.samplesPerSecond,
+         result.p50Ns, result.p99Ns, result.maxNs, bytes);
+#ifdef BENCH_MAX_P99_NS
+  TEST_ASSERT_LESS_THAN_DOUBLE_MESSAGE(BENCH_MAX_P99_NS, result.p99Ns, stage);
+#endif
+}
+
+void setUp() {}
+void tearDown() {}
+
+// ==== STAGES ====
+
+// Empty stage: the clock overhead to subtract from the rows below
+static void benchBaseline() {
+  BenchResult result = measure(records.size(), [](size_t) {});
+  report("(clock overhead)", result, 0);
+}
+
+static void benchConversion() {
+  volatile float sink = 0;
+  BenchResult result = measure(records.size(), [&](size_t i) {
+    sink = calibratedDmv(records[i].adcRaw) * (1.0f / DMV_PER_VOLT);  // adcToVoltage()
+  });
+  report("adcToVoltage", result, 0);
+}
+
+static void benchRing() {
+  static SampleRing<LogRecord, 1024> ring;
+  LogRecord out;
+  BenchResult result = measure(records.size(), [&](size_t i) {
+    ring.push(records[i]);
+    ring.pop(out);
+  });
+  report("ring push + pop", result, 0);
+}
+
+static void benchRawLog() {
+  MemoryFlash flash;
+  static uint8_t sector[MemoryFlash::SECTOR_SIZE];
+  size_t fill = 0;
+  size_t segmentBytes = SEGMENT_BYTES;
+  LogFileHeader header = makeLogHeader(BENCH_INTERVAL_MS * 1000);
+  auto put = [&](const uint8_t* data, size_t length) {
+    while (length > 0) {
+      size_t chunk = std::min(length, sizeof(sector) - fill);
+      memcpy(sector + fill, data, chunk);
+      fill += chunk;
+      data += chunk;
+      length -= chunk;
+      if (fill == sizeof(sector)) {
+        flash.write(sector, fill);
+        fill = 0;
+      }
+    }
+  };
+  BenchResult result = measure(records.size(), [&](size_t i) {
+    if (segmentBytes + sizeof(LogRecord) > SEGMENT_BYTES) {
+      put((const uint8_t*)&header, sizeof(header));
+      segmentBytes = sizeof(header);
+    }
+    put((const uint8_t*)&records[i], sizeof(LogRecord));
+    segmentBytes += sizeof(LogRecord);
+  });
+  flash.write(sector, fill);
+  report("raw log append", result, (double)flash.size() / records.size());
+}
+
+static void benchCompressedLog(MemoryFlash& flash) {
+  static uint8_t block[LOG_BLOCK_SIZE];
+  LogBlockEncoder encoder;
+  encoder.begin(block, BENCH_INTERVAL_MS);
+  BenchResult result = measure(records.size(), [&](size_t i) {
+    if (!encoder.add(records[i])) {
+      encoder.finish();
+      flash.write(block, LOG_BLOCK_SIZE);
+      encoder.begin(block, BENCH_INTERVAL_MS);
+      encoder.add(records[i]);
+    }
+  });
+  encoder.finish();
+  flash.write(block, LOG_BLOCK_SIZE);
+  // Plus one header block per segment
+  size_t blocksPerSegment = SEGMENT_BYTES / LOG_BLOCK_SIZE - 1;
+  size_t segments = (flash.size() / LOG_BLOCK_SIZE + blocksPerSegment - 1) / blocksPerSegment;
+  report("compressed log append", result, (double)(flash.size() + segments * LOG_BLOCK_SIZE) / records.size());
+}
+
+static void benchCompressedDecode(const MemoryFlash& flash, std::vector<LogRecord>& decoded) {
+  decoded.clear();
+  decoded.reserve(records.size());
+  LogBlockDecoder decoder;
+  size_t offset = 0;
+  bool pending = false;
+  BenchResult result = measure(records.size(), [&](size_t) {
+    LogRecord record;
+    while (!pending || !decoder.next(record)) {
+      if (offset + LOG_BLOCK_SIZE > flash.size()) return;
+      pending = decoder.begin(flash.data() + offset);
+      offset += LOG_BLOCK_SIZE;
+    }
+    decoded.push_back(record);
+  });
+  report("compressed decode", result, 0);
+}
+
+static void benchCsv() {
+  static char row[MAX_ROW_LENGTH];
+  size_t bytes = 0;
+  BenchResult result = measure(records.size(), [&](size_t i) {
+    bytes += formatCsvRow(row, records[i], false);
+  });
+  report("CSV row", result, (double)bytes / records.size());
+}
+
+// Telemetry wire format: COBS(header + 16 records + CRC) + delimiter
+static void benchTelemetry() {
+  const size_t batch = 16;
+  static uint8_t packet[sizeof(TelemetryHeader) + batch * sizeof(LogRecord) + 4];
+  static uint8_t encoded[cobsMaxEncodedLength(sizeof(packet)) + 1];
+  size_t count = 0;
+  size_t bytes = 0;
+  uint16_t sequence = 0;
+  BenchResult result = measure(records.size(), [&](size_t i) {
+    memcpy(packet + sizeof(TelemetryHeader) + count * sizeof(LogRecord), &records[i], sizeof(LogRecord));
+    if (++count < batch) return;
+    TelemetryHeader header = { TELEMETRY_SAMPLES, 0, sequence++, (uint8_t)count };
+    memcpy(packet, &header, sizeof(header));
+    size_t length = sizeof(header) + count * sizeof(LogRecord);
+    uint32_t crc = crc32Update(0, packet, length);
+    memcpy(packet + length, &crc, sizeof(crc));
+    bytes += cobsEncode(packet, length + sizeof(crc), encoded) + 1;
+    count = 0;
+  });
+  report("telemetry packet (16/pkt)", result, (double)bytes / records.size());
+}
+
+static void benchControl() {
+  PidController pid;
+  pid.configure(0.5f, 0.2f, 0.0f, BENCH_INTERVAL_MS * 1000, 0, DAC_MAX_CODE, FULL_SCALE_DMV, DAC_MAX_CODE);
+  pid.reset(0, 0);
+  volatile int32_t sink = 0;
+  BenchResult result = measure(records.size(), [&](size_t i) {
+    sink = pid.update(15000, calibratedDmv(records[i].adcRaw));
+  });
+  report("PID update", result, 0);
+}
+
+static void benchEstimator() {
+  StepEstimator estimator;
+  BenchResult result = measure(records.size(), [&](size_t i) {
+    estimator.addSample(records[i].timestamp / 1000.0, calibratedDmv(records[i].adcRaw) * 1e-4,
+                        dacCodeToDmv(records[i].dacCode) * 1e-4);
+  });
+  report("step estimator sample", result, 0);
+  StepFit fit;
+  TEST_ASSERT_TRUE(estimator.result(fit));
+  printf("  (fit on simulated plant: K %.3f, tau %.2f s, theta %.2f s)\n", fit.gain, fit.timeConstant, fit.deadTime);
+}
+
+// ==== SUITE ====
+
+static void test_pipeline_benchmarks() {
+  printf("\n  %u samples at %lu ms, simulated FOPDT plant (K 1, tau 20 s, theta 2 s)\n",
+         (unsigned)records.size(), (unsigned long)BENCH_INTERVAL_MS);
+  printf("  %-28s %12s %9s %9s %10s %9s\n", "stage", "samples/s", "p50 ns", "p99 ns", "max ns", "B/sample");
+  benchBaseline();
+  benchConversion();
+  benchRing();
+  benchRawLog();
+  MemoryFlash packed;
+  benchCompressedLog(packed);
+  std::vector<LogRecord> decoded;
+  benchCompressedDecode(packed, decoded);
+  benchCsv();
+  benchTelemetry();
+  benchControl();
+  benchEstimator();
+
+  TEST_ASSERT_EQUAL_UINT32(records.size(), decoded.size());
+  TEST_ASSERT_EQUAL_MEMORY(records.data(), decoded.data(), records.size() * sizeof(LogRecord));
+}
+
+static void test_compressed_beats_raw() {
+  MemoryFlash packed;
+  static uint8_t block[LOG_BLOCK_SIZE];
+  LogBlockEncoder encoder;
+  encoder.begin(block, BENCH_INTERVAL_MS);
+  for (const LogRecord& record : records) {
+    if (!encoder.add(record)) {
+      encoder.finish();
+      packed.write(block, LOG_BLOCK_SIZE);
+      encoder.begin(block, BENCH_INTERVAL_MS);
+      encoder.add(record);
+    }
+  }
+  encoder.finish();
+  packed.write(block, LOG_BLOCK_SIZE);
+  // A few LSB of noise must stay near one byte per sample
+  TEST_ASSERT_LESS_THAN(2 * records.size(), packed.size());
+}
+
+// Small integral gain on the firmware's scaling (dmv in, DAC code out,
+// 10 ms period): the integrator must still remove the P-only offset
+static void test_pid_small_ki_removes_offset() {
+  const uint32_t periodMs = 10;
+  const int32_t target = 15000;  // 1.5 V
+  SimulatedPlant plant(1.0f, 5.0f, 0.5f, periodMs / 1000.0f);
+  PidController pid;
+  TEST_ASSERT_TRUE(pid.configure(0.5f, 0.05f, 0.0f, periodMs * 1000, 0, DAC_MAX_CODE, FULL_SCALE_DMV, DAC_MAX_CODE));
+  pid.reset(0, 0);
+  const size_t steps = 300000 / periodMs;
+  const size_t settled = 10000 / periodMs;  // Mean of the last 10 s
+  int64_t sum = 0;
+  int32_t measurement = 0;
+  for (size_t i = 0; i < steps; i++) {
+    measurement = calibratedDmv(plant.readAdc());
+    if (i >= steps - settled) sum += measurement;
+    plant.writeDac((uint8_t)pid.update(target, measurement));
+  }
+  int32_t offset = (int32_t)(sum / (int64_t)settled) - target;
+  printf("  (PI kp 0.5, ki 0.05: steady-state offset %ld dmv)\n", (long)offset);
+  TEST_ASSERT_INT32_WITHIN(100, 0, offset);  // Under one DAC code (129 dmv)
+
+  TEST_ASSERT_FALSE(pid.configure(0.5f, 1e-7f, 0.0f, periodMs * 1000, 0, DAC_MAX_CODE, FULL_SCALE_DMV, DAC_MAX_CODE));
+}
+
+// Default sampling and commit interval, commits journaled the way
+// run_store does: the open block is sealed as it is and rewritten in its
+// slot, then keeps filling. Each snapshot must decode to every record so
+// far, and the run must stay well under the 7 bytes/sample of raw logs.
+static void test_commit_journal_bytes_per_sample() {
+  std::vector<LogRecord> slow = simulateStepTest(20000, DEFAULT_INTERVAL_MS, BENCH_STEP_CODE);
+  const size_t perCommit = DEFAULT_COMMIT_MS / DEFAULT_INTERVAL_MS;
+  MemoryFlash packed;
+  static uint8_t block[LOG_BLOCK_SIZE];
+  LogBlockEncoder encoder;
+  encoder.begin(block, DEFAULT_INTERVAL_MS, LOG_SEALED_PAYLOAD);
+  uint32_t first = 0;
+  for (size_t i = 0; i < slow.size(); i++) {
+    if (!encoder.add(slow[i])) {
+      encoder.finish();
+      sealLogBlock(block, first);
+      packed.write(block, LOG_BLOCK_SIZE);
+      first = i;
+      encoder.begin(block, DEFAULT_INTERVAL_MS, LOG_SEALED_PAYLOAD);
+      encoder.add(slow[i]);
+    }
+    if ((i + 1) % perCommit != 0) continue;
+    encoder.finish();
+    sealLogBlock(block, first);
+    LogBlockTrailer trailer;
+    TEST_ASSERT_TRUE(logBlockSealed(block, trailer));
+    LogBlockDecoder decoder;
+    TEST_ASSERT_TRUE(decoder.begin(block));
+    LogRecord record;
+    size_t decoded = 0;
+    while (decoder.next(record)) {
+      TEST_ASSERT_EQUAL_MEMORY(&slow[first + decoded], &record, sizeof(record));
+      decoded++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(i + 1 - first, decoded);
+  }
+  encoder.finish();
+  sealLogBlock(block, first);
+  packed.write(block, LOG_BLOCK_SIZE);
+
+  size_t blocksPerSegment = SEGMENT_BYTES / LOG_BLOCK_SIZE - 1;
+  size_t segments = (packed.size() / LOG_BLOCK_SIZE + blocksPerSegment - 1) / blocksPerSegment;
+  size_t bytes = packed.size() + segments * LOG_BLOCK_SIZE;
+  printf("  (default settings, commit every %lu ms: %.2f B/sample)\n", (unsigned long)DEFAULT_COMMIT_MS,
+         (double)bytes / slow.size());
+  TEST_ASSERT_LESS_THAN(2 * slow.size(), bytes);
+}
+
+static void test_csv_row_fits() {
+  LogRecord worst = { UINT32_MAX, ADC_MAX_CODE, DAC_MAX_CODE };
+  char row[MAX_ROW_LENGTH];
+  TEST_ASSERT_LESS_OR_EQUAL(MAX_ROW_LENGTH, formatCsvRow(row, worst, true));
+}
+
+int main() {
+  buildLinearCalibration();
+  records = simulateStepTest(BENCH_SAMPLES, BENCH_INTERVAL_MS, BENCH_STEP_CODE);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_pipeline_benchmarks);
+  RUN_TEST(test_compressed_beats_raw);
+  RUN_TEST(test_commit_journal_bytes_per_sample);
+  RUN_TEST(test_pid_small_ki_removes_offset);
+  RUN_TEST(test_csv_row_fits);
+  return UNITY_END();
+}
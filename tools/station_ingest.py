@@ -0,0 +1,608 @@
+#!/usr/bin/env python3
+"""Host companion for the temperature station: ingest and identify.
+
+Collects samples from any number of stations in parallel, stores them
+per station in a columnar file layout and runs the same streaming FOPDT
+identification as the firmware (step_estimator.h) on each, so the
+commissioning table is current while the tests are still running.
+Replaces the readtable / input() / tfest() flow of temp_station.m.
+
+Sources, one per station, as NAME=SOURCE:
+  lab1=/dev/ttyUSB0           serial console, COBS telemetry packets
+                              (telemetry_format.h); with --stream N the
+                              tool sends `stream N` to switch them on
+  lab2=ws://192.168.1.20/ws   Wi-Fi live samples (net_server.h)
+  old=run0003.bin             binary log or a capture of the 'b' dump
+                              (dump_format.h), raw or compressed runs
+
+Output, per station under --out:
+  NAME/timestamp.u32  NAME/adc.u16  NAME/dac.u8
+    little-endian columns, one element per record, appended as samples
+    arrive; numpy.memmap(path, dtype='<u4' / '<u2' / 'u1') reads them
+    while they grow
+  NAME/meta.json      record count, timestamp unit, sources, lost packets
+and fleet.csv with the latest fit of every station, rewritten every
+--report seconds.
+
+Volts are nominal (code * 3.3 V / full scale): the ADC calibration lives
+on the device, so fitted gains can differ from `e` by the calibration.
+
+Only the Python standard library is needed; serial sources also need
+pyserial.
+"""
+
+import argparse
+import base64
+import json
+import math
+import os
+import socket
+import struct
+import sys
+import threading
+import time
+import zlib
+from array import array
+from urllib.parse import urlparse
+
+# ==================== FORMATS (mirror include/*.h) ====================
+
+LOG_MAGIC = 0x474C5354            # "TSLG"
+LOG_FORMAT_VERSION = 2
+LOG_FLAG_TIMESTAMP_US = 0x0001
+LOG_FLAG_COMPRESSED = 0x0002
+LOG_FLAG_BLOCK_CRC = 0x0004
+
+LOG_FILE_HEADER = struct.Struct("<IHHIHH")   # magic, version, recordSize, samplingIntervalUs, flags, reserved
+LOG_RECORD = struct.Struct("<IHB")           # timestamp, adcRaw, dacCode
+LOG_BLOCK_HEADER = struct.Struct("<HHI")     # recordCount, payloadBytes, timestampStep (then first record, reserved)
+LOG_BLOCK_SIZE = 512
+LOG_BLOCK_HEADER_SIZE = 16
+LOG_BLOCK_PAYLOAD = LOG_BLOCK_SIZE - LOG_BLOCK_HEADER_SIZE
+LOG_TOKEN_LONG = 0x80
+LOG_TOKEN_REPEAT = 0x81
+
+DUMP_FRAME_MAGIC = 0x46445354     # "TSDF"
+DUMP_FRAME_HEADER = struct.Struct("<IHH")    # magic, sequence, length
+
+TELEMETRY_SAMPLES = 0x01
+TELEMETRY_HEADER = struct.Struct("<BBHB")    # type, flags, sequence, count
+
+ADC_MAX_CODE = 4095
+DAC_MAX_CODE = 255
+FULL_SCALE_V = 3.3
+
+
+def adc_volts(code):
+    return code * FULL_SCALE_V / ADC_MAX_CODE
+
+
+def dac_volts(code):
+    return code * FULL_SCALE_V / DAC_MAX_CODE
+
+
+def cobs_decode(data):
+    """One COBS packet without its delimiter; None if malformed."""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        i += 1
+        if code == 0 or i + code - 1 > len(data):
+            return None
+        out += data[i:i + code - 1]
+        i += code - 1
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def _varint(data, position, end):
+    value = 0
+    shift = 0
+    while position < end and shift < 64:
+        byte = data[position]
+        position += 1
+        value |= (byte & 0x7F) << shift
+        if not byte & 0x80:
+            return value, position
+        shift += 7
+    raise ValueError("truncated varint")
+
+
+def _unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def decode_block(block, sealed):
+    """Records of one compressed block (log_codec.h); [] if torn or corrupt."""
+    count, payload_bytes, step = LOG_BLOCK_HEADER.unpack_from(block, 0)
+    if count == 0 or payload_bytes > LOG_BLOCK_PAYLOAD:
+        return []
+    if sealed:
+        crc, = struct.unpack_from("<I", block, LOG_BLOCK_SIZE - 4)
+        if zlib.crc32(block[:LOG_BLOCK_SIZE - 4]) != crc:
+            return []
+    timestamp, adc, dac = LOG_RECORD.unpack_from(block, 8)
+    records = [(timestamp, adc, dac)]
+    delta = step
+    payload = LOG_BLOCK_HEADER_SIZE
+    position = payload
+    end = payload + payload_bytes
+    try:
+        while len(records) < count:
+            if position >= end:
+                break
+            token = block[position]
+            position += 1
+            if token < LOG_TOKEN_LONG:
+                adc += _unzigzag(token)
+                repeats = 1
+                dod = 0
+                dac_delta = 0
+            elif token == LOG_TOKEN_LONG:
+                value, position = _varint(block, position, end)
+                dod = _unzigzag(value)
+                value, position = _varint(block, position, end)
+                adc += _unzigzag(value)
+                value, position = _varint(block, position, end)
+                dac_delta = _unzigzag(value)
+                repeats = 1
+            elif token == LOG_TOKEN_REPEAT:
+                repeats, position = _varint(block, position, end)
+                if repeats < 2:
+                    break
+                dod = 0
+                dac_delta = 0
+            else:
+                break
+            delta += dod
+            dac = (dac + dac_delta) & 0xFF
+            adc &= 0xFFFF
+            for _ in range(min(repeats, count - len(records))):
+                timestamp = (timestamp + delta) & 0xFFFFFFFF
+                records.append((timestamp, adc, dac))
+    except ValueError:
+        pass  # Corrupt payload: keep what decoded
+    return records
+
+
+def parse_log(data):
+    """(flags, interval_us, records) of a binary log: header + records or blocks."""
+    if len(data) < LOG_FILE_HEADER.size:
+        raise ValueError("too short for a log header")
+    magic, version, record_size, interval_us, flags, _ = LOG_FILE_HEADER.unpack_from(data, 0)
+    if magic != LOG_MAGIC or version != LOG_FORMAT_VERSION or record_size != LOG_RECORD.size:
+        raise ValueError("not a station log (bad header)")
+    body = memoryview(data)[LOG_FILE_HEADER.size:]
+    records = []
+    if flags & LOG_FLAG_COMPRESSED:
+        sealed = bool(flags & LOG_FLAG_BLOCK_CRC)
+        for offset in range(0, len(body) - LOG_BLOCK_SIZE + 1, LOG_BLOCK_SIZE):
+            records += decode_block(bytes(body[offset:offset + LOG_BLOCK_SIZE]), sealed)
+    else:
+        usable = len(body) - len(body) % LOG_RECORD.size
+        records = list(LOG_RECORD.iter_unpack(body[:usable]))
+    return flags, interval_us, records
+
+
+def unframe_dump(data):
+    """File bytes of a captured 'b' dump; the CRCs are checked."""
+    start = data.find(struct.pack("<I", DUMP_FRAME_MAGIC))
+    if start < 0:
+        return None
+    content = bytearray()
+    position = start
+    while position + DUMP_FRAME_HEADER.size <= len(data):
+        magic, _, length = DUMP_FRAME_HEADER.unpack_from(data, position)
+        if magic != DUMP_FRAME_MAGIC:
+            raise ValueError("dump frame lost sync at byte %d" % position)
+        position += DUMP_FRAME_HEADER.size
+        payload = data[position:position + length]
+        crc, = struct.unpack_from("<I", data, position + length)
+        position += length + 4
+        if length == 0:
+            if zlib.crc32(content) != crc:
+                raise ValueError("dump file CRC mismatch")
+            return bytes(content)
+        if zlib.crc32(payload) != crc:
+            raise ValueError("dump frame CRC mismatch")
+        content += payload
+    raise ValueError("dump ends without its final frame")
+
+
+# ==================== IDENTIFICATION (mirror step_estimator.h) ====================
+
+class StepEstimator:
+    """Streaming FOPDT fit, G(s) = K e^(-theta s) / (tau s + 1)."""
+
+    INPUT_EPSILON = 1e-4
+    NOISE_SIGMAS = 4.0
+    MIN_THRESHOLD_V = 0.002
+    MIN_FIT_SAMPLES = 8
+
+    def __init__(self):
+        self.baseline_count = 0
+        self.baseline_mean = 0.0
+        self.baseline_m2 = 0.0
+        self.u0 = self.u_step = self.du = self.t0 = 0.0
+        self.threshold = self.integral = self.last_y = self.last_t = 0.0
+        self.xx = [[0.0] * 3 for _ in range(3)]
+        self.xi = [0.0] * 3
+        self.count = 0
+        self.stepped = self.responding = self.frozen = False
+
+    def add(self, t, y, u):
+        if self.frozen:
+            return
+        if self.baseline_count == 0 and not self.stepped:
+            self.u0 = u
+        if not self.stepped:
+            if abs(u - self.u0) <= self.INPUT_EPSILON:
+                self.baseline_count += 1
+                delta = y - self.baseline_mean
+                self.baseline_mean += delta / self.baseline_count
+                self.baseline_m2 += delta * (y - self.baseline_mean)
+                return
+            if self.baseline_count == 0:
+                self.frozen = True
+                return
+            self.stepped = True
+            self.t0 = t
+            self.du = u - self.u0
+            self.u_step = u
+            self.last_y = y - self.baseline_mean
+            self.last_t = 0.0
+            sigma = math.sqrt(self.baseline_m2 / (self.baseline_count - 1)) if self.baseline_count > 1 else 0.0
+            self.threshold = max(self.NOISE_SIGMAS * sigma, self.MIN_THRESHOLD_V)
+        elif abs(u - self.u_step) > self.INPUT_EPSILON:
+            self.frozen = True
+            return
+
+        tr = t - self.t0
+        dev = y - self.baseline_mean
+        self.integral += 0.5 * (dev + self.last_y) * (tr - self.last_t)
+        self.last_y = dev
+        self.last_t = tr
+        if not self.responding and abs(dev) < self.threshold:
+            return
+        self.responding = True
+        x = (tr, 1.0, dev)
+        for i in range(3):
+            for j in range(i, 3):
+                self.xx[i][j] += x[i] * x[j]
+            self.xi[i] += x[i] * self.integral
+        self.count += 1
+
+    @staticmethod
+    def _det3(m):
+        return (m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]))
+
+    def result(self):
+        """dict with gain, tau, theta, baseline, step, samples; None until solvable."""
+        if not self.stepped or self.count < self.MIN_FIT_SAMPLES or self.du == 0:
+            return None
+        a = [[self.xx[i][j] if j >= i else self.xx[j][i] for j in range(3)] for i in range(3)]
+        det = self._det3(a)
+        if abs(det) < 1e-12:
+            return None
+        p = []
+        for k in range(3):
+            m = [[self.xi[i] if j == k else a[i][j] for j in range(3)] for i in range(3)]
+            p.append(self._det3(m) / det)
+        if p[0] == 0 or -p[2] <= 0:
+            return None
+        return {"gain": p[0] / self.du, "tau": -p[2], "theta": -p[1] / p[0],
+                "baseline": self.baseline_mean, "step": self.du, "samples": self.count}
+
+
+# ==================== COLUMNAR STORE ====================
+
+class ColumnStore:
+    """Appends records to NAME/{timestamp.u32, adc.u16, dac.u8} plus meta.json."""
+
+    COLUMNS = (("timestamp.u32", "I"), ("adc.u16", "H"), ("dac.u8", "B"))
+
+    def __init__(self, directory, station, source):
+        self.directory = os.path.join(directory, station)
+        os.makedirs(self.directory, exist_ok=True)
+        self.files = [open(os.path.join(self.directory, name), "ab") for name, _ in self.COLUMNS]
+        self.pending = [array(code) for _, code in self.COLUMNS]
+        for column in self.pending:
+            if column.itemsize != {"I": 4, "H": 2, "B": 1}[column.typecode]:
+                raise RuntimeError("unexpected array item size on this platform")
+        self.count = os.path.getsize(os.path.join(self.directory, self.COLUMNS[0][0])) // 4
+        self.meta = {"station": station, "sources": [source], "records": self.count,
+                     "timestamp_unit": "ms", "lost_packets": 0}
+        path = os.path.join(self.directory, "meta.json")
+        if os.path.exists(path):
+            with open(path) as f:
+                previous = json.load(f)
+            previous["sources"] = previous.get("sources", []) + [source]
+            self.meta.update({k: v for k, v in previous.items() if k != "records"})
+
+    def append(self, records):
+        for timestamp, adc, dac in records:
+            self.pending[0].append(timestamp)
+            self.pending[1].append(adc)
+            self.pending[2].append(dac)
+        if len(self.pending[0]) >= 4096:
+            self.flush()
+
+    def flush(self):
+        for column, f in zip(self.pending, self.files):
+            if sys.byteorder != "little":
+                column.byteswap()
+            column.tofile(f)
+            f.flush()
+        self.count += len(self.pending[0])
+        self.pending = [array(code) for _, code in self.COLUMNS]
+        self.meta["records"] = self.count
+        with open(os.path.join(self.directory, "meta.json.tmp"), "w") as f:
+            json.dump(self.meta, f, indent=1)
+        os.replace(os.path.join(self.directory, "meta.json.tmp"), os.path.join(self.directory, "meta.json"))
+
+    def close(self):
+        self.flush()
+        for f in self.files:
+            f.close()
+
+
+# ==================== SOURCES ====================
+# Each yields (flags, sequence or None, records)
+
+def serial_batches(port, baud, stream, stop):
+    try:
+        import serial  # pyserial
+    except ImportError:
+        raise RuntimeError("serial sources need pyserial (pip install pyserial)")
+    link = serial.Serial(port, baud, timeout=0.2)
+    try:
+        if stream:
+            link.write(b"stream %d\n" % stream)
+        pending = bytearray()
+        while not stop.is_set():
+            pending += link.read(4096)
+            while True:
+                end = pending.find(0)
+                if end < 0:
+                    break
+                frame = bytes(pending[:end])
+                del pending[:end + 1]
+                packet = cobs_decode(frame) if frame else None
+                batch = parse_telemetry(packet, with_crc=True) if packet else None
+                if batch:
+                    yield batch
+            if len(pending) > 65536:
+                del pending[:-1024]  # Console text without packets
+    finally:
+        if stream:
+            link.write(b"stream off\n")
+        link.close()
+
+
+def parse_telemetry(packet, with_crc):
+    if with_crc:
+        if len(packet) < TELEMETRY_HEADER.size + 4:
+            return None
+        crc, = struct.unpack_from("<I", packet, len(packet) - 4)
+        packet = packet[:-4]
+        if zlib.crc32(packet) != crc:
+            return None
+    if len(packet) < TELEMETRY_HEADER.size:
+        return None
+    kind, flags, sequence, count = TELEMETRY_HEADER.unpack_from(packet, 0)
+    body = packet[TELEMETRY_HEADER.size:]
+    if kind != TELEMETRY_SAMPLES or len(body) != count * LOG_RECORD.size:
+        return None
+    return flags, sequence, list(LOG_RECORD.iter_unpack(body))
+
+
+def websocket_batches(url, stop):
+    """Minimal RFC 6455 client: binary messages are TelemetryHeader + records."""
+    parts = urlparse(url)
+    sock = socket.create_connection((parts.hostname, parts.port or 80), timeout=5)
+    key = base64.b64encode(os.urandom(16)).decode()
+    request = ("GET %s HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+               "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n\r\n") % (parts.path or "/", parts.hostname, key)
+    sock.sendall(request.encode())
+    response = b""
+    while b"\r\n\r\n" not in response:
+        chunk = sock.recv(1024)
+        if not chunk:
+            raise RuntimeError("websocket handshake failed")
+        response += chunk
+    if b" 101 " not in response.split(b"\r\n", 1)[0]:
+        raise RuntimeError("websocket upgrade refused: %r" % response.split(b"\r\n", 1)[0])
+    buffer = bytearray(response.split(b"\r\n\r\n", 1)[1])
+    sock.settimeout(0.5)
+
+    def need(n):
+        while len(buffer) < n:
+            if stop.is_set():
+                return False
+            try:
+                chunk = sock.recv(4096)
+            except socket.timeout:
+                continue
+            if not chunk:
+                raise RuntimeError("websocket closed")
+            buffer.extend(chunk)
+        return True
+
+    try:
+        while need(2):
+            opcode = buffer[0] & 0x0F
+            length = buffer[1] & 0x7F
+            header = 2
+            if length == 126:
+                if not need(4):
+                    return
+                length, = struct.unpack_from(">H", buffer, 2)
+                header = 4
+            elif length == 127:
+                if not need(10):
+                    return
+                length, = struct.unpack_from(">Q", buffer, 2)
+                header = 10
+            if not need(header + length):
+                return
+            payload = bytes(buffer[header:header + length])
+            del buffer[:header + length]
+            if opcode == 0x8:
+                return
+            if opcode == 0x9:  # Ping: answer with a masked pong
+                mask = os.urandom(4)
+                sock.sendall(bytes([0x8A, 0x80 | len(payload)]) + mask +
+                             bytes(b ^ mask[i % 4] for i, b in enumerate(payload)))
+            elif opcode == 0x2:
+                batch = parse_telemetry(payload, with_crc=False)
+                if batch:
+                    yield batch
+    finally:
+        sock.close()
+
+
+def file_batches(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    content = data if data[:4] == struct.pack("<I", LOG_MAGIC) else unframe_dump(data)
+    if content is None:
+        raise RuntimeError("%s is neither a binary log nor a dump capture" % path)
+    flags, _, records = parse_log(content)
+    for start in range(0, len(records), 4096):
+        yield flags, None, records[start:start + 4096]
+
+
+# ==================== STATIONS ====================
+
+class Station(threading.Thread):
+    def __init__(self, name, source, args, stop):
+        super().__init__(name=name, daemon=True)
+        self.station = name
+        self.source = source
+        self.args = args
+        self.stop = stop
+        self.lock = threading.Lock()
+        self.estimator = StepEstimator()
+        self.store = ColumnStore(args.out, name, source)
+        self.samples = 0
+        self.lost = 0
+        self.status = "starting"
+        self.live = not os.path.isfile(source)
+
+    def batches(self):
+        if self.source.startswith("ws://"):
+            return websocket_batches(self.source, self.stop)
+        if os.path.isfile(self.source):
+            return file_batches(self.source)
+        return serial_batches(self.source, self.args.baud, self.args.stream, self.stop)
+
+    def run(self):
+        expected = None
+        try:
+            self.status = "running"
+            for flags, sequence, records in self.batches():
+                if sequence is not None:
+                    if expected is not None and sequence != expected:
+                        self.lost += (sequence - expected) & 0xFFFF
+                    expected = (sequence + 1) & 0xFFFF
+                scale = 1e-6 if flags & LOG_FLAG_TIMESTAMP_US else 1e-3
+                self.store.meta["timestamp_unit"] = "us" if flags & LOG_FLAG_TIMESTAMP_US else "ms"
+                with self.lock:
+                    self.store.append(records)
+                    for timestamp, adc, dac in records:
+                        self.estimator.add(timestamp * scale, adc_volts(adc), dac_volts(dac))
+                    self.samples += len(records)
+                if self.stop.is_set():
+                    break
+            self.status = "done" if not self.live else "stopped"
+        except Exception as error:  # One bad station must not stop the fleet
+            self.status = "error: %s" % error
+        finally:
+            with self.lock:
+                self.store.meta["lost_packets"] = self.lost
+                self.store.close()
+
+    def report(self):
+        with self.lock:
+            fit = self.estimator.result()
+            if fit:
+                phase = "frozen" if self.estimator.frozen else "fitting"
+            elif self.estimator.stepped:
+                phase = "waiting for response"
+            else:
+                phase = "baseline"
+            return {"station": self.station, "status": self.status, "samples": self.samples,
+                    "lost_packets": self.lost, "phase": phase, "fit": fit}
+
+
+FLEET_COLUMNS = ("station", "status", "samples", "lost_packets", "phase",
+                 "gain", "tau_s", "theta_s", "baseline_v", "step_v", "fit_samples")
+
+
+def write_fleet(path, rows):
+    with open(path + ".tmp", "w") as f:
+        f.write(",".join(FLEET_COLUMNS) + "\n")
+        for row in rows:
+            fit = row["fit"] or {}
+            values = [row["station"], row["status"].replace(",", ";"), row["samples"], row["lost_packets"], row["phase"]]
+            values += ["%.6g" % fit[k] if k in fit else "" for k in ("gain", "tau", "theta", "baseline", "step")]
+            values.append(fit.get("samples", ""))
+            f.write(",".join(str(v) for v in values) + "\n")
+    os.replace(path + ".tmp", path)
+
+
+def print_fleet(rows):
+    print("%-12s %-10s %9s %5s %-20s %8s %8s %8s" % ("station", "status", "samples", "lost", "phase", "K", "tau s", "theta s"))
+    for row in rows:
+        fit = row["fit"]
+        numbers = ("%8.4f %8.3f %8.3f" % (fit["gain"], fit["tau"], fit["theta"])) if fit else ""
+        print("%-12s %-10s %9d %5d %-20s %s" % (row["station"], row["status"][:10], row["samples"],
+                                               row["lost_packets"], row["phase"], numbers))
+    sys.stdout.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("sources", nargs="+", metavar="NAME=SOURCE",
+                        help="serial port, ws://host/ws or a .bin log / dump capture")
+    parser.add_argument("--out", default="ingest", help="output directory (default: ingest)")
+    parser.add_argument("--baud", type=int, default=115200, help="serial speed (default: 115200)")
+    parser.add_argument("--stream", type=int, default=0,
+                        help="send `stream N` to serial stations on connect (every N-th sample)")
+    parser.add_argument("--report", type=float, default=2.0, help="seconds between fleet reports")
+    args = parser.parse_args()
+
+    os.makedirs(args.out, exist_ok=True)
+    stop = threading.Event()
+    stations = []
+    for spec in args.sources:
+        name, sep, source = spec.partition("=")
+        if not sep or not name or not source:
+            parser.error("expected NAME=SOURCE, got %r" % spec)
+        stations.append(Station(name, source, args, stop))
+    for station in stations:
+        station.start()
+
+    fleet_path = os.path.join(args.out, "fleet.csv")
+    try:
+        while any(station.is_alive() for station in stations):
+            time.sleep(args.report)
+            rows = [station.report() for station in stations]
+            write_fleet(fleet_path, rows)
+            print_fleet(rows)
+    except KeyboardInterrupt:
+        stop.set()
+        for station in stations:
+            station.join(timeout=2)
+    rows = [station.report() for station in stations]
+    write_fleet(fleet_path, rows)
+    print_fleet(rows)
+    print("Columns and fleet.csv in %s" % args.out)
+
+
+if __name__ == "__main__":
+    main()